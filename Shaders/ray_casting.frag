@@ -8,6 +8,9 @@ in VS_OUT {
 
 uniform sampler3D volume;
 uniform sampler1D transfer_function;
+uniform sampler3D illumination;
+uniform sampler3D packed_gradients;
+uniform sampler3D packed_values;
 uniform vec3 volume_resolution;
 uniform vec3 volume_ratio;
 
@@ -19,8 +22,15 @@ uniform float sample_rate;
 
 uniform bool useLighting;
 uniform bool useNormalColor;
+uniform bool useIllumination;
+uniform int gradientEncoding;
+uniform float gradientMagnitudeScale;
+uniform bool useAdaptiveStep;
+uniform float boundaryGradient;
+uniform float adaptiveEmptyAlpha;
+uniform float adaptiveLowAlpha;
 
-vec3 PhongShading(vec3 normal, vec3 color, vec3 position) {    
+vec3 PhongShading(vec3 normal, vec3 color, vec3 position, float shadow) {    
     // ambient
     float ambientStrength = 0.1f;
     vec3 ambient = ambientStrength * lightColor;
@@ -42,10 +52,52 @@ vec3 PhongShading(vec3 normal, vec3 color, vec3 position) {
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 64.0f);
     vec3 specular = specularStrength * spec * lightColor; 
 
-    vec3 result = clamp(vec3(ambient + diffuse + specular) * color, 0.0f, 1.0f);
+    // shadow 是預先算好的光照體積，只影響直接光
+    vec3 result = clamp(vec3(ambient + (diffuse + specular) * shadow) * color, 0.0f, 1.0f);
     return result;
 }
 
+vec3 OctahedralDecode(vec2 encoded) {
+    vec3 n = vec3(encoded.xy, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+// 打包的梯度：八面體編碼在摺線兩側不連續，不能讓硬體內插編碼。
+// 材質是 GL_NEAREST，8 個角落各自解碼成梯度後再自己做三線性內插（跟 GL_LINEAR 的位置一樣）
+vec3 FetchPackedGradient(vec3 position) {
+    ivec3 size = textureSize(packed_gradients, 0);
+    vec3 texel = clamp(position * vec3(size) - 0.5f, vec3(0.0f), vec3(size - 1));
+    ivec3 base = ivec3(floor(texel));
+    vec3 f = texel - vec3(base);
+    vec3 result = vec3(0.0f);
+    for (int i = 0; i < 8; i++) {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        ivec3 corner = min(base + offset, size - 1);
+        vec3 weights = mix(1.0f - f, f, vec3(offset));
+        vec3 code = texelFetch(packed_gradients, corner, 0).rgb;
+        result += weights.x * weights.y * weights.z * OctahedralDecode(code.rg * 2.0f - 1.0f) * code.b;
+    }
+    return result * gradientMagnitudeScale;
+}
+
+// 自適應步長：sample_rate 的 0.5、1、2、4 倍（alpha 門檻由 Source/CpuRay.h 的常數傳進來）
+// 梯度大（相對 max_gradient）的邊界用小步長，幾乎透明又平滑的地方用大步長
+float AdaptiveStepScale(float alpha, float gradient) {
+    if (gradient > boundaryGradient) {
+        return 0.5f;
+    }
+    if (alpha < adaptiveEmptyAlpha && gradient < boundaryGradient * 0.25f) {
+        return 4.0f;
+    }
+    if (alpha < adaptiveLowAlpha && gradient < boundaryGradient * 0.5f) {
+        return 2.0f;
+    }
+    return 1.0f;
+}
+
 void main() {
     vec4 result = vec4(0.0f);
     vec3 ray_direction = normalize(fs_in.FragPos - viewPos);
@@ -54,20 +106,43 @@ void main() {
     vec3 current_pos = fs_in.FragPos;
 
     while (true) {
-        vec4 volume_data = texture(volume, sample_pos);
+        // 跟 volume 材質一樣的格式：rgb 是梯度，a 是數值
+        vec4 volume_data = vec4(0.0f);
+        if (gradientEncoding == 0) {
+            volume_data = texture(volume, sample_pos);
+        } else {
+            volume_data.a = texture(packed_values, sample_pos).r;
+        }
         vec4 volume_color = texture(transfer_function, volume_data.a);
+        // 打包的梯度要 8 次 texelFetch 加解碼，只在用得到的樣本才取：自適應步長每個樣本都要，光照和法向量顏色只有不透明的樣本要
+        if (gradientEncoding != 0 && (useAdaptiveStep || ((useLighting || useNormalColor) && volume_color.a > 0.0f))) {
+            volume_data.rgb = FetchPackedGradient(sample_pos);
+        }
         if (useNormalColor) {
             volume_color.r = volume_data.r;
             volume_color.g = volume_data.g;
             volume_color.b = volume_data.b;
         }
 
+        float shadow = 1.0f;
+        if (useIllumination) {
+            shadow = texture(illumination, sample_pos).r;
+        }
+
         vec3 temp_color = vec3(0.0f);
-        if (useLighting) {
-            temp_color = PhongShading(volume_data.rgb, volume_color.rgb, current_pos);
+        if (useLighting && volume_color.a > 0.0f) {
+            temp_color = PhongShading(volume_data.rgb, volume_color.rgb, current_pos, shadow);
         } else {
-            temp_color = volume_color.rgb;
+            temp_color = volume_color.rgb * shadow;
+        }
+
+        // 步長改變時 opacity 也要跟著修正
+        float step_scale = 1.0f;
+        if (useAdaptiveStep) {
+            step_scale = AdaptiveStepScale(volume_color.a, length(volume_data.rgb));
+            volume_color.a = 1.0f - pow(1.0f - volume_color.a, step_scale);
         }
+        float step = sample_rate * step_scale;
 
          result.rgb += (1.0f - result.a) * volume_color.a * temp_color.rgb;
 		 result.a += (1.0f - result.a) * volume_color.a;
@@ -77,14 +152,14 @@ void main() {
          }
 
         // 實際的位置也改變，相對材質座標也要改變
-        current_pos = current_pos + ray_direction * sample_rate;
+        current_pos = current_pos + ray_direction * step;
 
         vec3 ray_direction_in_texture = vec3(1.0f);
         ray_direction_in_texture.x = ray_direction.x / (volume_resolution.x * volume_ratio.x);
         ray_direction_in_texture.y = ray_direction.y / (volume_resolution.y * volume_ratio.y);
         ray_direction_in_texture.z = ray_direction.z / (volume_resolution.z * volume_ratio.z);
 
-        sample_pos = sample_pos + ray_direction_in_texture * sample_rate;
+        sample_pos = sample_pos + ray_direction_in_texture * step;
         if (current_pos.x < -volume_resolution.x / 2.0f || current_pos.x > volume_resolution.x / 2.0f) {
             break;
         }
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Chunked bump allocator for outputs that are rebuilt over and over, like the extracted iso surface.
+// Reset() releases every allocation at once but keeps the chunks, so regenerating the same amount of data
+// does not touch the heap again. Objects are never destructed, only use it for trivially destructible types.
+class ChunkArena {
+public:
+	struct Stats {
+		size_t heap_allocations = 0;	// chunks requested from the heap over the lifetime
+		size_t heap_releases = 0;		// chunks given back by Release() over the lifetime
+		size_t allocations = 0;			// Allocate() calls since the last Reset()
+		size_t bytes_in_use = 0;
+		size_t peak_bytes = 0;
+		size_t reserved_bytes = 0;		// total size of the chunks
+	};
+
+	explicit ChunkArena(size_t chunk_size = 16 << 20) : chunk_size(chunk_size) {}
+
+	ChunkArena(const ChunkArena&) = delete;
+	ChunkArena& operator=(const ChunkArena&) = delete;
+
+	template<typename T>
+	T* Allocate(size_t count) {
+		return static_cast<T*>(AllocateBytes(count * sizeof(T), alignof(T)));
+	}
+
+	// Make sure `bytes` fit into the chunks from the current position on, e.g. after a count pass. The missing part is
+	// added as one chunk at the end, so a growing output costs a single heap allocation and no chunk is left unused.
+	// Allocations do not span chunks, so callers add some slack for the tail of every chunk.
+	void Reserve(size_t bytes) {
+		size_t available = 0;
+		for (size_t i = current; i < chunks.size(); i++) {
+			available += chunks[i].size - (i == current ? offset : 0);
+		}
+		if (available < bytes) {
+			AddChunk(bytes - available);
+		}
+	}
+
+	// Free everything allocated so far but keep the memory for the next round.
+	void Reset() {
+		current = 0;
+		offset = 0;
+		stats.allocations = 0;
+		stats.bytes_in_use = 0;
+	}
+
+	// Give the chunks back to the heap.
+	void Release() {
+		stats.heap_releases += chunks.size();
+		chunks.clear();
+		stats.reserved_bytes = 0;
+		Reset();
+	}
+
+	const Stats& GetStats() const { return stats; }
+	size_t GetChunkSize() const { return chunk_size; }
+
+private:
+	struct Chunk {
+		std::unique_ptr<unsigned char[]> data;
+		size_t size;
+	};
+
+	void* AllocateBytes(size_t bytes, size_t alignment) {
+		while (current < chunks.size()) {
+			const size_t aligned = (offset + alignment - 1) / alignment * alignment;
+			if (aligned + bytes <= chunks[current].size) {
+				offset = aligned + bytes;
+				stats.allocations++;
+				stats.bytes_in_use += bytes;
+				stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes_in_use);
+				return chunks[current].data.get() + aligned;
+			}
+			current++;
+			offset = 0;
+		}
+		AddChunk(bytes + alignment);
+		return AllocateBytes(bytes, alignment);
+	}
+
+	void AddChunk(size_t min_size) {
+		const size_t size = std::max(min_size, chunk_size);
+		chunks.push_back(Chunk{ std::make_unique<unsigned char[]>(size), size });
+		stats.heap_allocations++;
+		stats.reserved_bytes += size;
+	}
+
+	size_t chunk_size;
+	std::vector<Chunk> chunks;
+	size_t current = 0;
+	size_t offset = 0;
+	Stats stats;
+};
@@ -0,0 +1,120 @@
+#include "CpuIsoRenderer.h"
+
+#include <chrono>
+#include <cmath>
+
+void CpuIsoRenderer::Render(const VolumeData& volume, const CpuRenderView& view, float iso_value, unsigned char* pixels) {
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	if (volume.IsEmpty() || view.width <= 0 || view.height <= 0) {
+		return;
+	}
+
+	const glm::mat4 inverse_view_projection = glm::inverse(view.projection * view.view);
+	const float normalized_iso_value = iso_value / 255.0f;
+	const int tiles_x = (view.width + TileSize - 1) / TileSize;
+	const int tiles_y = (view.height + TileSize - 1) / TileSize;
+
+	scheduler.ParallelFor(static_cast<size_t>(tiles_x) * tiles_y, [&](size_t tile) {
+		const int x_begin = static_cast<int>(tile % tiles_x) * TileSize;
+		const int y_begin = static_cast<int>(tile / tiles_x) * TileSize;
+		const int x_end = std::min(x_begin + TileSize, view.width);
+		const int y_end = std::min(y_begin + TileSize, view.height);
+
+		for (int y = y_begin; y < y_end; y++) {
+			for (int x = x_begin; x < x_end; x++) {
+				const float ndc_x = (x + 0.5f) / view.width * 2.0f - 1.0f;
+				const float ndc_y = (y + 0.5f) / view.height * 2.0f - 1.0f;
+				const CpuRay ray = GenerateRay(inverse_view_projection, ndc_x, ndc_y);
+				const glm::vec3 color = TracePixel(volume, view, ray, normalized_iso_value);
+
+				unsigned char* pixel = &pixels[(static_cast<size_t>(y) * view.width + x) * 4];
+				pixel[0] = static_cast<unsigned char>(color.x * 255.0f + 0.5f);
+				pixel[1] = static_cast<unsigned char>(color.y * 255.0f + 0.5f);
+				pixel[2] = static_cast<unsigned char>(color.z * 255.0f + 0.5f);
+				pixel[3] = 255;
+			}
+		}
+	});
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	last_render_time = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+glm::vec3 CpuIsoRenderer::TracePixel(const VolumeData& volume, const CpuRenderView& view, const CpuRay& ray, float iso_value) const {
+	const glm::vec3 half_size = view.volume_size * 0.5f;
+	float t_near, t_far;
+	if (!IntersectBox(ray, -half_size, half_size, t_near, t_far)) {
+		return view.background_color;
+	}
+
+	auto field = [&](float t) {
+		return volume.SampleValue(WorldToTexCoord(ray.origin + ray.direction * t, view.volume_size)) - iso_value;
+	};
+
+	float t_prev = t_near;
+	float f_prev = field(t_prev);
+	for (float t = t_near + step_size; t <= t_far + step_size; t += step_size) {
+		const float t_curr = std::min(t, t_far);
+		const float f_curr = field(t_curr);
+
+		if ((f_prev < 0.0f) != (f_curr < 0.0f)) {
+			// 找到穿過等值面的區間，用 regula falsi 在三線性內插的場上逼近根
+			float t_low = t_prev, f_low = f_prev;
+			float t_high = t_curr, f_high = f_curr;
+			float t_hit = t_curr;
+			for (int i = 0; i < 6; i++) {
+				t_hit = t_low + (t_high - t_low) * f_low / (f_low - f_high);
+				const float f_hit = field(t_hit);
+				if ((f_hit < 0.0f) == (f_low < 0.0f)) {
+					t_low = t_hit;
+					f_low = f_hit;
+				} else {
+					t_high = t_hit;
+					f_high = f_hit;
+				}
+			}
+
+			const glm::vec3 position = ray.origin + ray.direction * t_hit;
+			const glm::vec3 gradient = glm::vec3(volume.Sample(WorldToTexCoord(position, view.volume_size)));
+			if (use_lighting && glm::dot(gradient, gradient) <= 0.0f) {
+				return glm::clamp(object_color, 0.0f, 1.0f);
+			}
+			return Shade(gradient, position, view);
+		}
+
+		t_prev = t_curr;
+		f_prev = f_curr;
+	}
+	return view.background_color;
+}
+
+// Same lighting model as Shaders/simple_lighting.frag.
+glm::vec3 CpuIsoRenderer::Shade(const glm::vec3& normal, const glm::vec3& position, const CpuRenderView& view) const {
+	if (!use_lighting) {
+		return glm::clamp(object_color, 0.0f, 1.0f);
+	}
+
+	// ambient
+	const float ambient_strength = 0.1f;
+	const glm::vec3 ambient = ambient_strength * view.light_color;
+
+	// diffuse
+	glm::vec3 norm = glm::normalize(normal);
+	const glm::vec3 light_dir = glm::normalize(view.light_position - position);
+	float diff = glm::dot(norm, light_dir);
+	if (diff <= 0.0f) {
+		diff *= -1.0f;
+		norm = -norm;
+	}
+	const glm::vec3 diffuse = diff * view.light_color;
+
+	// specular
+	const float specular_strength = 0.5f;
+	const glm::vec3 view_dir = glm::normalize(view.view_position - position);
+	const glm::vec3 reflect_dir = glm::reflect(-light_dir, norm);
+	const float spec = std::pow(std::max(glm::dot(view_dir, reflect_dir), 0.0f), 32.0f);
+	const glm::vec3 specular = specular_strength * spec * view.light_color;
+
+	return glm::clamp((ambient + diffuse + specular) * object_color, 0.0f, 1.0f);
+}
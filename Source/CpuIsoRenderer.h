@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CpuRay.h"
+#include "TaskScheduler.h"
+#include "VolumeData.h"
+
+// Renders the iso surface directly from the scalar field on the CPU, without extracting any triangles.
+// The screen is split into tiles which are handed to the TaskScheduler.
+class CpuIsoRenderer {
+public:
+	explicit CpuIsoRenderer(TaskScheduler& scheduler) : scheduler(scheduler) {}
+
+	// iso_value is in [0, 255]. pixels must hold width * height RGBA8 texels, they are written bottom row first.
+	void Render(const VolumeData& volume, const CpuRenderView& view, float iso_value, unsigned char* pixels);
+
+	void SetStepSize(float size) { step_size = size; }
+	void SetObjectColor(const glm::vec3& color) { object_color = color; }
+	// Same switch as is_volume in simple_lighting.frag, off means flat object color.
+	void SetUseLighting(bool value) { use_lighting = value; }
+	float GetLastRenderTime() const { return last_render_time; }
+
+	static constexpr int TileSize = 16;
+
+private:
+	glm::vec3 TracePixel(const VolumeData& volume, const CpuRenderView& view, const CpuRay& ray, float iso_value) const;
+	glm::vec3 Shade(const glm::vec3& normal, const glm::vec3& position, const CpuRenderView& view) const;
+
+	TaskScheduler& scheduler;
+	float step_size = 0.5f;
+	glm::vec3 object_color = glm::vec3(0.482352941f, 0.68627451f, 0.929411765f);
+	bool use_lighting = false;
+	float last_render_time = 0.0f;
+};
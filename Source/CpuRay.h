@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <utility>
+
+// Adaptive sampling (Main passes the alpha thresholds to ray_casting.frag as uniforms): the step is sample_rate times 0.5, 1, 2 or 4.
+// Samples whose gradient magnitude (relative to max_gradient) is above the boundary threshold get the fine step,
+// nearly transparent samples in smooth regions the coarse ones. Opacity is corrected for the step length.
+const float kAdaptiveEmptyAlpha = 0.002f;
+const float kAdaptiveLowAlpha = 0.02f;
+
+// Everything a CPU renderer needs to know about the current frame.
+struct CpuRenderView {
+	int width = 0;
+	int height = 0;
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::vec3 view_position = glm::vec3(0.0f);
+	glm::vec3 light_position = glm::vec3(0.0f);
+	glm::vec3 light_color = glm::vec3(1.0f);
+	glm::vec3 background_color = glm::vec3(0.0f);
+	// Resolution * ratio, the volume is centered at the world origin (see the model matrix in Render()).
+	glm::vec3 volume_size = glm::vec3(1.0f);
+};
+
+struct CpuRay {
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+// ndc_x and ndc_y are in [-1, 1]. Works for both perspective and orthogonal projections.
+inline CpuRay GenerateRay(const glm::mat4& inverse_view_projection, float ndc_x, float ndc_y) {
+	glm::vec4 near_point = inverse_view_projection * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+	glm::vec4 far_point = inverse_view_projection * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+	const glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+	const glm::vec3 target = glm::vec3(far_point) / far_point.w;
+	return { origin, glm::normalize(target - origin) };
+}
+
+// Slab test against the axis-aligned box, returns false if the ray misses it.
+inline bool IntersectBox(const CpuRay& ray, const glm::vec3& box_min, const glm::vec3& box_max, float& t_near, float& t_far) {
+	t_near = 0.0f;
+	t_far = 1e30f;
+	for (int axis = 0; axis < 3; axis++) {
+		const float inverse = 1.0f / ray.direction[axis];
+		float t0 = (box_min[axis] - ray.origin[axis]) * inverse;
+		float t1 = (box_max[axis] - ray.origin[axis]) * inverse;
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+		t_near = std::max(t_near, t0);
+		t_far = std::min(t_far, t1);
+	}
+	return t_near < t_far;
+}
+
+// World position -> texture coordinate of the volume.
+inline glm::vec3 WorldToTexCoord(const glm::vec3& position, const glm::vec3& volume_size) {
+	return position / volume_size + glm::vec3(0.5f);
+}
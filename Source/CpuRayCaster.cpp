@@ -0,0 +1,363 @@
+#include "CpuRayCaster.h"
+#include "CpuRayPacket.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace simd_portable {
+	// Plain arrays, the compiler is free to vectorize the loops with whatever the baseline ISA offers.
+	constexpr int Width = CpuRayCaster::PacketWidth;
+
+	struct Float {
+		float lane[Width];
+		Float() = default;
+		Float(float value) { for (int i = 0; i < Width; i++) lane[i] = value; }
+		static Float Load(const float* data) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = data[i]; return r; }
+	};
+	struct Int {
+		int32_t lane[Width];
+		Int() = default;
+		Int(int32_t value) { for (int i = 0; i < Width; i++) lane[i] = value; }
+	};
+	struct Mask {
+		bool lane[Width];
+	};
+
+#define PORTABLE_BINARY_OP(Type, Result, op) \
+	inline Result operator op(const Type& a, const Type& b) { Result r; for (int i = 0; i < Width; i++) r.lane[i] = a.lane[i] op b.lane[i]; return r; }
+	PORTABLE_BINARY_OP(Float, Float, +)
+	PORTABLE_BINARY_OP(Float, Float, -)
+	PORTABLE_BINARY_OP(Float, Float, *)
+	PORTABLE_BINARY_OP(Float, Float, /)
+	PORTABLE_BINARY_OP(Float, Mask, <)
+	PORTABLE_BINARY_OP(Float, Mask, <=)
+	PORTABLE_BINARY_OP(Int, Int, +)
+	PORTABLE_BINARY_OP(Int, Int, *)
+	PORTABLE_BINARY_OP(Mask, Mask, &)
+#undef PORTABLE_BINARY_OP
+
+	inline void Store(float* data, const Float& a) { for (int i = 0; i < Width; i++) data[i] = a.lane[i]; }
+	inline Float Min(const Float& a, const Float& b) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = a.lane[i] < b.lane[i] ? a.lane[i] : b.lane[i]; return r; }
+	inline Float Max(const Float& a, const Float& b) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = a.lane[i] > b.lane[i] ? a.lane[i] : b.lane[i]; return r; }
+	inline Int Min(const Int& a, const Int& b) { Int r; for (int i = 0; i < Width; i++) r.lane[i] = a.lane[i] < b.lane[i] ? a.lane[i] : b.lane[i]; return r; }
+	inline Int Max(const Int& a, const Int& b) { Int r; for (int i = 0; i < Width; i++) r.lane[i] = a.lane[i] > b.lane[i] ? a.lane[i] : b.lane[i]; return r; }
+	inline Float Sqrt(const Float& a) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = std::sqrt(a.lane[i]); return r; }
+	inline Float Floor(const Float& a) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = std::floor(a.lane[i]); return r; }
+	inline Int ToInt(const Float& a) { Int r; for (int i = 0; i < Width; i++) r.lane[i] = static_cast<int32_t>(std::clamp(a.lane[i], -kPacketIntLimit, kPacketIntLimit)); return r; }
+	inline Float Lerp(const Float& a, const Float& b, const Float& t) { return a + (b - a) * t; }
+	inline Float Select(const Mask& m, const Float& a, const Float& b) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = m.lane[i] ? a.lane[i] : b.lane[i]; return r; }
+	inline Float Gather(const float* base, const Int& index) { Float r; for (int i = 0; i < Width; i++) r.lane[i] = base[index.lane[i]]; return r; }
+	inline Int Gather(const int32_t* base, const Int& index) { Int r; for (int i = 0; i < Width; i++) r.lane[i] = base[index.lane[i]]; return r; }
+	inline bool Any(const Mask& m) { bool r = false; for (int i = 0; i < Width; i++) r |= m.lane[i]; return r; }
+
+	struct Simd {
+		using Float = simd_portable::Float;
+		using Int = simd_portable::Int;
+		using Mask = simd_portable::Mask;
+		static constexpr int Width = simd_portable::Width;
+	};
+}
+
+namespace {
+	using PacketFunction = size_t (*)(const RayCastContext&, const CpuRay*, const float*, const float*, int, float*);
+
+	size_t TraceRayPacketPortable(const RayCastContext& ctx, const CpuRay* rays, const float* ray_t_near, const float* ray_t_far, int count, float* results) {
+		return TraceRayPacket<simd_portable::Simd>(ctx, rays, ray_t_near, ray_t_far, count, results);
+	}
+
+	glm::vec4 SampleColormap(const std::vector<float>& colormap, float value) {
+		const int size = static_cast<int>(colormap.size() / 4);
+		const float u = std::clamp(value, 0.0f, 1.0f) * size - 0.5f;
+		const int i0 = static_cast<int>(std::floor(u));
+		const float w = u - i0;
+		const int u0 = std::clamp(i0, 0, size - 1) * 4;
+		const int u1 = std::clamp(i0 + 1, 0, size - 1) * 4;
+		return glm::mix(glm::vec4(colormap[u0], colormap[u0 + 1], colormap[u0 + 2], colormap[u0 + 3]),
+			glm::vec4(colormap[u1], colormap[u1 + 1], colormap[u1 + 2], colormap[u1 + 3]), w);
+	}
+
+	// PhongShading() in ray_casting.frag
+	glm::vec3 PhongShading(const RayCastContext& ctx, const glm::vec3& normal, const glm::vec3& color, const glm::vec3& position) {
+		const glm::vec3 ambient = 0.1f * ctx.light_color;
+
+		// Empty regions have no gradient, keep them at ambient lighting instead of NaN
+		glm::vec3 norm = normal / std::sqrt(std::max(glm::dot(normal, normal), 1e-20f));
+		const glm::vec3 light_dir = glm::normalize(ctx.light_position - position);
+		float diff = glm::dot(norm, light_dir);
+		if (diff <= 0.0f) {
+			diff *= -1.0f;
+			norm = -norm;
+		}
+		const glm::vec3 diffuse = diff * ctx.light_color;
+
+		const glm::vec3 view_dir = glm::normalize(ctx.view_position - position);
+		const glm::vec3 reflect_dir = glm::reflect(-light_dir, norm);
+		const float spec = std::pow(std::max(glm::dot(view_dir, reflect_dir), 0.0f), 64.0f);
+		const glm::vec3 specular = 0.5f * spec * ctx.light_color;
+
+		return glm::clamp((ambient + diffuse + specular) * color, 0.0f, 1.0f);
+	}
+
+	// Step length (in units of sample_rate) for adaptive sampling, see kAdaptiveEmptyAlpha.
+	float AdaptiveStepScale(const RayCastContext& ctx, float alpha, float gradient) {
+		if (ctx.boundary_gradient < gradient) {
+			return 0.5f;
+		}
+		if (alpha < kAdaptiveEmptyAlpha && gradient < ctx.boundary_gradient * 0.25f) {
+			return 4.0f;
+		}
+		if (alpha < kAdaptiveLowAlpha && gradient < ctx.boundary_gradient * 0.5f) {
+			return 2.0f;
+		}
+		return 1.0f;
+	}
+
+	// Single ray reference path, one trilinear sample per step through VolumeData.
+	glm::vec4 TraceRay(const RayCastContext& ctx, const VolumeData& volume, const std::vector<float>& colormap, const CpuRay& ray, float t, float t_far, size_t& samples) {
+		glm::vec4 result(0.0f);
+		while (t <= t_far) {
+			samples++;
+			const glm::vec3 position = ray.origin + ray.direction * t;
+			const glm::vec4 volume_data = volume.Sample(WorldToTexCoord(position, ctx.volume_size));
+			glm::vec4 volume_color = SampleColormap(colormap, volume_data.w);
+			if (ctx.use_normal_color) {
+				volume_color = glm::vec4(glm::vec3(volume_data), volume_color.w);
+			}
+
+			const glm::vec3 temp_color = ctx.use_lighting ? PhongShading(ctx, glm::vec3(volume_data), glm::vec3(volume_color), position) : glm::vec3(volume_color);
+			float step_scale = 1.0f;
+			if (ctx.use_adaptive_step) {
+				step_scale = AdaptiveStepScale(ctx, volume_color.w, glm::length(glm::vec3(volume_data)));
+				volume_color.w = 1.0f - std::pow(1.0f - volume_color.w, step_scale);
+			}
+			const float weight = (1.0f - result.w) * volume_color.w;
+			result = result + glm::vec4(weight * temp_color, weight);
+			if (result.w > 0.99f) {
+				break;
+			}
+			t += ctx.sample_rate * step_scale;
+		}
+		return result;
+	}
+
+	void WritePixel(unsigned char* pixels, size_t index, const glm::vec4& result, const glm::vec3& background) {
+		// Same background blend as the end of ray_casting.frag
+		const glm::vec3 color = glm::clamp(background * (1.0f - result.w) + glm::vec3(result) * result.w, 0.0f, 1.0f);
+		unsigned char* pixel = &pixels[index * 4];
+		pixel[0] = static_cast<unsigned char>(color.x * 255.0f + 0.5f);
+		pixel[1] = static_cast<unsigned char>(color.y * 255.0f + 0.5f);
+		pixel[2] = static_cast<unsigned char>(color.z * 255.0f + 0.5f);
+		pixel[3] = 255;
+	}
+
+	bool CpuSupportsAvx2() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 1);
+		const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+		const bool has_avx = (info[2] & (1 << 28)) != 0;
+		const bool has_fma = (info[2] & (1 << 12)) != 0;
+		if (!has_osxsave || !has_avx || !has_fma || (_xgetbv(0) & 0x6) != 0x6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+		return false;
+#endif
+	}
+}
+
+CpuRayCaster::CpuRayCaster(TaskScheduler& scheduler) : scheduler(scheduler), kernel(GetBestKernel()) {
+}
+
+void CpuRayCaster::SetKernel(CpuRayCastKernel new_kernel) {
+	kernel = IsKernelSupported(new_kernel) ? new_kernel : GetBestKernel();
+}
+
+bool CpuRayCaster::IsKernelSupported(CpuRayCastKernel kernel) {
+	switch (kernel) {
+		case CPU_KERNEL_SCALAR:
+		case CPU_KERNEL_PACKET:
+			return true;
+		case CPU_KERNEL_AVX2:
+#ifdef ENABLE_AVX2_KERNEL
+			static const bool is_supported = CpuSupportsAvx2();
+			return is_supported;
+#else
+			return false;
+#endif
+		default:
+			return false;
+	}
+}
+
+CpuRayCastKernel CpuRayCaster::GetBestKernel() {
+	return IsKernelSupported(CPU_KERNEL_AVX2) ? CPU_KERNEL_AVX2 : CPU_KERNEL_PACKET;
+}
+
+const char* CpuRayCaster::GetKernelName(CpuRayCastKernel kernel) {
+	switch (kernel) {
+		case CPU_KERNEL_SCALAR:
+			return "Scalar";
+		case CPU_KERNEL_PACKET:
+			return "Packet x8";
+		case CPU_KERNEL_AVX2:
+			return "AVX2 x8";
+		default:
+			return "Unknown";
+	}
+}
+
+void CpuRayCaster::Render(const VolumeData& volume, const CpuRenderView& view, const std::vector<float>& colormap, unsigned char* pixels) {
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	if (volume.IsEmpty() || colormap.empty() || view.width <= 0 || view.height <= 0) {
+		return;
+	}
+
+	RayCastContext ctx;
+	ctx.voxels = volume.GetRawData();
+	ctx.offset_x = volume.GetOffsetsX();
+	ctx.offset_y = volume.GetOffsetsY();
+	ctx.offset_z = volume.GetOffsetsZ();
+	ctx.resolution = volume.GetResolution();
+	ctx.colormap = colormap.data();
+	ctx.colormap_size = static_cast<int>(colormap.size() / 4);
+	ctx.volume_size = view.volume_size;
+	ctx.view_position = view.view_position;
+	ctx.light_position = view.light_position;
+	ctx.light_color = view.light_color;
+	ctx.sample_rate = sample_rate;
+	ctx.use_lighting = use_lighting;
+	ctx.use_normal_color = use_normal_color;
+	ctx.use_adaptive_step = use_adaptive_step;
+	ctx.boundary_gradient = boundary_gradient;
+	std::atomic<size_t> total_samples{ 0 };
+
+	// VolumeData keeps the float indices inside int32, which is what the packet gathers use
+	PacketFunction trace_packet = TraceRayPacketPortable;
+#ifdef ENABLE_AVX2_KERNEL
+	if (kernel == CPU_KERNEL_AVX2) {
+		trace_packet = TraceRayPacketAvx2;
+	}
+#endif
+
+	const glm::mat4 inverse_view_projection = glm::inverse(view.projection * view.view);
+	const glm::vec3 half_size = view.volume_size * 0.5f;
+	const int tiles_x = (view.width + TileSize - 1) / TileSize;
+	const int tiles_y = (view.height + TileSize - 1) / TileSize;
+
+	scheduler.ParallelFor(static_cast<size_t>(tiles_x) * tiles_y, [&](size_t tile) {
+		const int x_begin = static_cast<int>(tile % tiles_x) * TileSize;
+		const int y_begin = static_cast<int>(tile / tiles_x) * TileSize;
+		const int x_end = std::min(x_begin + TileSize, view.width);
+		const int y_end = std::min(y_begin + TileSize, view.height);
+
+		CpuRay rays[PacketWidth];
+		float t_near[PacketWidth];
+		float t_far[PacketWidth];
+		float results[PacketWidth * 4];
+		size_t tile_samples = 0;
+
+		for (int y = y_begin; y < y_end; y++) {
+			for (int x = x_begin; x < x_end; x += PacketWidth) {
+				const int count = std::min(PacketWidth, x_end - x);
+				for (int i = 0; i < count; i++) {
+					const float ndc_x = (x + i + 0.5f) / view.width * 2.0f - 1.0f;
+					const float ndc_y = (y + 0.5f) / view.height * 2.0f - 1.0f;
+					rays[i] = GenerateRay(inverse_view_projection, ndc_x, ndc_y);
+					if (!IntersectBox(rays[i], -half_size, half_size, t_near[i], t_far[i])) {
+						t_far[i] = -1.0f;
+					}
+				}
+
+				if (kernel == CPU_KERNEL_SCALAR) {
+					for (int i = 0; i < count; i++) {
+						const glm::vec4 result = TraceRay(ctx, volume, colormap, rays[i], t_near[i], t_far[i], tile_samples);
+						results[i * 4 + 0] = result.x;
+						results[i * 4 + 1] = result.y;
+						results[i * 4 + 2] = result.z;
+						results[i * 4 + 3] = result.w;
+					}
+				} else {
+					tile_samples += trace_packet(ctx, rays, t_near, t_far, count, results);
+				}
+
+				for (int i = 0; i < count; i++) {
+					const glm::vec4 result(results[i * 4 + 0], results[i * 4 + 1], results[i * 4 + 2], results[i * 4 + 3]);
+					WritePixel(pixels, static_cast<size_t>(y) * view.width + x + i, result, view.background_color);
+				}
+			}
+		}
+		total_samples += tile_samples;
+	});
+	last_sample_count = total_samples;
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	last_render_time = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void CpuRayCaster::Benchmark(const VolumeData& volume, const CpuRenderView& view, const std::vector<float>& colormap, unsigned char* pixels) {
+	const CpuRayCastKernel previous_kernel = kernel;
+	const double ray_count = static_cast<double>(view.width) * view.height;
+	const int repeat = 3;
+	float scalar_time = 0.0f;
+
+	Nexus::Logger::Message(Nexus::LOG_INFO, "CPU ray casting benchmark (" + std::to_string(view.width) + "x" + std::to_string(view.height) + ", " + std::to_string(scheduler.GetThreadCount()) + " threads):");
+	for (CpuRayCastKernel candidate : { CPU_KERNEL_SCALAR, CPU_KERNEL_PACKET, CPU_KERNEL_AVX2 }) {
+		if (!IsKernelSupported(candidate)) {
+			Nexus::Logger::Message(Nexus::LOG_INFO, std::string(GetKernelName(candidate)) + ": not supported on this CPU.");
+			continue;
+		}
+
+		kernel = candidate;
+		float best_time = 1e30f;
+		for (int i = 0; i < repeat; i++) {
+			Render(volume, view, colormap, pixels);
+			best_time = std::min(best_time, last_render_time);
+		}
+		if (candidate == CPU_KERNEL_SCALAR) {
+			scalar_time = best_time;
+		}
+
+		const double mrays = ray_count / (best_time * 1000.0);
+		Nexus::Logger::Message(Nexus::LOG_INFO, std::string(GetKernelName(candidate)) + ": " + std::to_string(best_time) + " ms, "
+			+ std::to_string(mrays) + " MRays/s, x" + std::to_string(scalar_time / best_time) + " vs scalar");
+	}
+	kernel = previous_kernel;
+
+	// Uniform against adaptive steps with the current kernel: samples, time and the largest pixel difference
+	const bool previous_adaptive = use_adaptive_step;
+	const size_t pixel_bytes = static_cast<size_t>(view.width) * view.height * 4;
+	std::vector<unsigned char> uniform_pixels(pixel_bytes);
+	use_adaptive_step = false;
+	Render(volume, view, colormap, uniform_pixels.data());
+	const size_t uniform_samples = last_sample_count;
+	const float uniform_time = last_render_time;
+	use_adaptive_step = true;
+	Render(volume, view, colormap, pixels);
+	int max_difference = 0;
+	double sum_difference = 0.0;
+	for (size_t i = 0; i < pixel_bytes; i++) {
+		const int difference = std::abs(static_cast<int>(pixels[i]) - static_cast<int>(uniform_pixels[i]));
+		max_difference = std::max(max_difference, difference);
+		sum_difference += difference;
+	}
+	Nexus::Logger::Message(Nexus::LOG_INFO, "Adaptive step: " + std::to_string(last_sample_count) + " samples (" + std::to_string(last_render_time) + " ms) vs "
+		+ std::to_string(uniform_samples) + " uniform (" + std::to_string(uniform_time) + " ms), "
+		+ std::to_string(100.0 * last_sample_count / std::max<size_t>(uniform_samples, 1)) + "% of the samples, pixel difference max "
+		+ std::to_string(max_difference) + " mean " + std::to_string(sum_difference / pixel_bytes));
+	use_adaptive_step = previous_adaptive;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CpuRay.h"
+#include "TaskScheduler.h"
+#include "VolumeData.h"
+
+#include <string>
+#include <vector>
+
+enum CpuRayCastKernel {
+	CPU_KERNEL_SCALAR,	// one ray at a time
+	CPU_KERNEL_PACKET,	// 8-wide packets, portable C++
+	CPU_KERNEL_AVX2,	// 8-wide packets, AVX2 intrinsics
+};
+
+// CPU version of Shaders/ray_casting.frag. The kernel is chosen at runtime from the CPU features.
+class CpuRayCaster {
+public:
+	explicit CpuRayCaster(TaskScheduler& scheduler);
+
+	// colormap is the RGBA float table of the transfer function (TransferFunctionWidget::get_colormapf()).
+	// pixels must hold width * height RGBA8 texels, they are written bottom row first.
+	void Render(const VolumeData& volume, const CpuRenderView& view, const std::vector<float>& colormap, unsigned char* pixels);
+
+	// Render the same view with every supported kernel and log the throughput.
+	void Benchmark(const VolumeData& volume, const CpuRenderView& view, const std::vector<float>& colormap, unsigned char* pixels);
+
+	void SetKernel(CpuRayCastKernel kernel);
+	CpuRayCastKernel GetKernel() const { return kernel; }
+	void SetSampleRate(float rate) { sample_rate = rate; }
+	void SetUseLighting(bool enable) { use_lighting = enable; }
+	void SetUseNormalColor(bool enable) { use_normal_color = enable; }
+	void SetUseAdaptiveStep(bool enable) { use_adaptive_step = enable; }
+	// Gradient magnitude, relative to max_gradient, above which the step is halved.
+	void SetBoundaryGradient(float gradient) { boundary_gradient = gradient; }
+	float GetLastRenderTime() const { return last_render_time; }
+	size_t GetLastSampleCount() const { return last_sample_count; }
+
+	static bool IsKernelSupported(CpuRayCastKernel kernel);
+	static CpuRayCastKernel GetBestKernel();
+	static const char* GetKernelName(CpuRayCastKernel kernel);
+
+	static constexpr int TileSize = 16;
+	static constexpr int PacketWidth = 8;
+
+private:
+	TaskScheduler& scheduler;
+	CpuRayCastKernel kernel;
+	float sample_rate = 0.5f;
+	bool use_lighting = true;
+	bool use_normal_color = false;
+	bool use_adaptive_step = false;
+	float boundary_gradient = 0.3f;
+	float last_render_time = 0.0f;
+	size_t last_sample_count = 0;
+};
@@ -0,0 +1,67 @@
+// This file is compiled with AVX2 enabled (see CMakeLists.txt), only call into it after checking the CPU.
+// Everything except TraceRayPacketAvx2() stays in the anonymous namespace: an inline function with external linkage
+// emitted here could be picked by the linker for the whole program and then crash on CPUs without AVX2.
+#include "CpuRayPacket.h"
+
+#include <cstdint>
+#include <immintrin.h>
+
+namespace {
+namespace simd_avx2 {
+	struct Float {
+		__m256 v;
+		Float() = default;
+		Float(float value) : v(_mm256_set1_ps(value)) {}
+		explicit Float(__m256 value) : v(value) {}
+		static Float Load(const float* data) { return Float(_mm256_load_ps(data)); }
+	};
+	struct Int {
+		__m256i v;
+		Int() = default;
+		Int(int32_t value) : v(_mm256_set1_epi32(value)) {}
+		explicit Int(__m256i value) : v(value) {}
+	};
+	struct Mask {
+		__m256 v;
+		explicit Mask(__m256 value) : v(value) {}
+	};
+
+	inline Float operator+(const Float& a, const Float& b) { return Float(_mm256_add_ps(a.v, b.v)); }
+	inline Float operator-(const Float& a, const Float& b) { return Float(_mm256_sub_ps(a.v, b.v)); }
+	inline Float operator*(const Float& a, const Float& b) { return Float(_mm256_mul_ps(a.v, b.v)); }
+	inline Float operator/(const Float& a, const Float& b) { return Float(_mm256_div_ps(a.v, b.v)); }
+	inline Mask operator<(const Float& a, const Float& b) { return Mask(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+	inline Mask operator<=(const Float& a, const Float& b) { return Mask(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+	inline Int operator+(const Int& a, const Int& b) { return Int(_mm256_add_epi32(a.v, b.v)); }
+	inline Int operator*(const Int& a, const Int& b) { return Int(_mm256_mullo_epi32(a.v, b.v)); }
+	inline Mask operator&(const Mask& a, const Mask& b) { return Mask(_mm256_and_ps(a.v, b.v)); }
+
+	inline void Store(float* data, const Float& a) { _mm256_store_ps(data, a.v); }
+	inline Float Min(const Float& a, const Float& b) { return Float(_mm256_min_ps(a.v, b.v)); }
+	inline Float Max(const Float& a, const Float& b) { return Float(_mm256_max_ps(a.v, b.v)); }
+	inline Int Min(const Int& a, const Int& b) { return Int(_mm256_min_epi32(a.v, b.v)); }
+	inline Int Max(const Int& a, const Int& b) { return Int(_mm256_max_epi32(a.v, b.v)); }
+	inline Float Sqrt(const Float& a) { return Float(_mm256_sqrt_ps(a.v)); }
+	inline Float Floor(const Float& a) { return Float(_mm256_floor_ps(a.v)); }
+	inline Int ToInt(const Float& a) {
+		const __m256 limit = _mm256_set1_ps(kPacketIntLimit);
+		return Int(_mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(a.v, _mm256_sub_ps(_mm256_setzero_ps(), limit)), limit)));
+	}
+	inline Float Lerp(const Float& a, const Float& b, const Float& t) { return Float(_mm256_fmadd_ps(_mm256_sub_ps(b.v, a.v), t.v, a.v)); }
+	inline Float Select(const Mask& m, const Float& a, const Float& b) { return Float(_mm256_blendv_ps(b.v, a.v, m.v)); }
+	inline Float Gather(const float* base, const Int& index) { return Float(_mm256_i32gather_ps(base, index.v, 4)); }
+	inline Int Gather(const int32_t* base, const Int& index) { return Int(_mm256_i32gather_epi32(reinterpret_cast<const int*>(base), index.v, 4)); }
+	inline bool Any(const Mask& m) { return _mm256_movemask_ps(m.v) != 0; }
+
+	struct Simd {
+		using Float = simd_avx2::Float;
+		using Int = simd_avx2::Int;
+		using Mask = simd_avx2::Mask;
+		static constexpr int Width = 8;
+	};
+}
+}
+
+size_t TraceRayPacketAvx2(const RayCastContext& ctx, const CpuRay* rays, const float* ray_t_near, const float* ray_t_far, int count, float* results) {
+	return TraceRayPacket<simd_avx2::Simd>(ctx, rays, ray_t_near, ray_t_far, count, results);
+}
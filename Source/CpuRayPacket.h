@@ -0,0 +1,226 @@
+#pragma once
+
+#include "CpuRay.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// ToInt() of the packet kernels clamps to this first, a float outside the int32 range would be UB to convert.
+const float kPacketIntLimit = 1073741824.0f;
+
+// Read-only data shared by every ray of a CPU ray casting frame.
+struct RayCastContext {
+	const float* voxels = nullptr;		// RGBA floats in any VolumeLayout
+	const int32_t* offset_x = nullptr;	// per-axis voxel offsets, see VolumeData
+	const int32_t* offset_y = nullptr;
+	const int32_t* offset_z = nullptr;
+	glm::ivec3 resolution = glm::ivec3(0);
+	const float* colormap = nullptr;	// RGBA floats of the transfer function
+	int colormap_size = 0;
+	glm::vec3 volume_size = glm::vec3(1.0f);
+	glm::vec3 view_position = glm::vec3(0.0f);
+	glm::vec3 light_position = glm::vec3(0.0f);
+	glm::vec3 light_color = glm::vec3(1.0f);
+	float sample_rate = 0.5f;
+	bool use_lighting = true;
+	bool use_normal_color = false;
+	bool use_adaptive_step = false;
+	float boundary_gradient = 0.3f;
+};
+
+// Traces up to Simd::Width rays at once with the rays stored as structure of arrays.
+// The math follows Shaders/ray_casting.frag, results[i * 4] is the accumulated (rgb, alpha) before the background blend.
+// Returns the number of samples taken by all rays of the packet.
+// Simd provides Float / Int / Mask types with the usual operators plus Float::Load and the free functions
+// Store, Gather (float and int32 tables), Select, Lerp, Floor, ToInt, Min, Max, Sqrt and Any, found through ADL.
+// ToInt has to clamp out-of-range values itself. The body only reads glm members and writes raw floats, so an
+// instantiation inside the AVX2 file never emits an inline glm function which the linker could share with other files.
+template<typename Simd>
+size_t TraceRayPacket(const RayCastContext& ctx, const CpuRay* rays, const float* ray_t_near, const float* ray_t_far, int count, float* results) {
+	using Float = typename Simd::Float;
+	using Int = typename Simd::Int;
+	using Mask = typename Simd::Mask;
+	constexpr int Width = Simd::Width;
+
+	// AoS -> SoA
+	alignas(32) float lanes[8][Width];
+	for (int i = 0; i < Width; i++) {
+		const bool is_valid = i < count;
+		const CpuRay& ray = rays[is_valid ? i : 0];
+		lanes[0][i] = ray.origin.x;
+		lanes[1][i] = ray.origin.y;
+		lanes[2][i] = ray.origin.z;
+		lanes[3][i] = ray.direction.x;
+		lanes[4][i] = ray.direction.y;
+		lanes[5][i] = ray.direction.z;
+		lanes[6][i] = is_valid ? ray_t_near[i] : 0.0f;
+		lanes[7][i] = is_valid ? ray_t_far[i] : -1.0f;
+	}
+	const Float origin_x = Float::Load(lanes[0]), origin_y = Float::Load(lanes[1]), origin_z = Float::Load(lanes[2]);
+	const Float dir_x = Float::Load(lanes[3]), dir_y = Float::Load(lanes[4]), dir_z = Float::Load(lanes[5]);
+	const Float t_far = Float::Load(lanes[7]);
+	Float t = Float::Load(lanes[6]);
+
+	const Float zero(0.0f), one(1.0f), half(0.5f);
+	const Float texel_scale_x(ctx.resolution.x / ctx.volume_size.x);
+	const Float texel_scale_y(ctx.resolution.y / ctx.volume_size.y);
+	const Float texel_scale_z(ctx.resolution.z / ctx.volume_size.z);
+	const Float texel_offset_x(ctx.resolution.x * 0.5f - 0.5f);
+	const Float texel_offset_y(ctx.resolution.y * 0.5f - 0.5f);
+	const Float texel_offset_z(ctx.resolution.z * 0.5f - 0.5f);
+	const Int int_zero(0), int_one(1), int_four(4);
+	const Int max_x(ctx.resolution.x - 1), max_y(ctx.resolution.y - 1), max_z(ctx.resolution.z - 1);
+	const Float colormap_scale(static_cast<float>(ctx.colormap_size));
+	const Int colormap_max(ctx.colormap_size - 1);
+	const Float step(ctx.sample_rate);
+	const Float two(2.0f), four(4.0f);
+	const Float fine_gradient(ctx.boundary_gradient);
+	const Float smooth_gradient(ctx.boundary_gradient * 0.25f), low_gradient(ctx.boundary_gradient * 0.5f);
+	const Float empty_alpha(kAdaptiveEmptyAlpha), low_alpha(kAdaptiveLowAlpha);
+
+	Float result_r(0.0f), result_g(0.0f), result_b(0.0f), result_a(0.0f);
+	Float samples(0.0f);
+	Mask active = t <= t_far;
+
+	while (Any(active)) {
+		samples = samples + Select(active, one, zero);
+
+		const Float pos_x = origin_x + dir_x * t;
+		const Float pos_y = origin_y + dir_y * t;
+		const Float pos_z = origin_z + dir_z * t;
+
+		// World position -> texel space, texel centers are at integer coordinates
+		const Float sx = pos_x * texel_scale_x + texel_offset_x;
+		const Float sy = pos_y * texel_scale_y + texel_offset_y;
+		const Float sz = pos_z * texel_scale_z + texel_offset_z;
+		const Float floor_x = Floor(sx), floor_y = Floor(sy), floor_z = Floor(sz);
+		const Float wx = sx - floor_x, wy = sy - floor_y, wz = sz - floor_z;
+		const Int ix = ToInt(floor_x), iy = ToInt(floor_y), iz = ToInt(floor_z);
+		// Clamp to edge, then map to the voxel layout through the offset tables
+		const Int x0 = Gather(ctx.offset_x, Min(Max(ix, int_zero), max_x)), x1 = Gather(ctx.offset_x, Min(Max(ix + int_one, int_zero), max_x));
+		const Int y0 = Gather(ctx.offset_y, Min(Max(iy, int_zero), max_y)), y1 = Gather(ctx.offset_y, Min(Max(iy + int_one, int_zero), max_y));
+		const Int z0 = Gather(ctx.offset_z, Min(Max(iz, int_zero), max_z)), z1 = Gather(ctx.offset_z, Min(Max(iz + int_one, int_zero), max_z));
+		const Int corners[8] = {
+			(z0 + y0 + x0) * int_four, (z0 + y0 + x1) * int_four,
+			(z0 + y1 + x0) * int_four, (z0 + y1 + x1) * int_four,
+			(z1 + y0 + x0) * int_four, (z1 + y0 + x1) * int_four,
+			(z1 + y1 + x0) * int_four, (z1 + y1 + x1) * int_four,
+		};
+
+		// Trilinear sample of gradient (rgb) and value (a)
+		Float volume_data[4];
+		for (int c = 0; c < 4; c++) {
+			const float* channel = ctx.voxels + c;
+			const Float c00 = Lerp(Gather(channel, corners[0]), Gather(channel, corners[1]), wx);
+			const Float c10 = Lerp(Gather(channel, corners[2]), Gather(channel, corners[3]), wx);
+			const Float c01 = Lerp(Gather(channel, corners[4]), Gather(channel, corners[5]), wx);
+			const Float c11 = Lerp(Gather(channel, corners[6]), Gather(channel, corners[7]), wx);
+			volume_data[c] = Lerp(Lerp(c00, c10, wy), Lerp(c01, c11, wy), wz);
+		}
+
+		// Transfer function lookup, linear filtering and clamp to edge like the 1D texture
+		const Float u = Min(Max(volume_data[3], zero), one) * colormap_scale - half;
+		const Float floor_u = Floor(u);
+		const Float wu = u - floor_u;
+		const Int iu = ToInt(floor_u);
+		const Int u0 = Min(Max(iu, int_zero), colormap_max) * int_four;
+		const Int u1 = Min(Max(iu + int_one, int_zero), colormap_max) * int_four;
+		Float color[4];
+		for (int c = 0; c < 4; c++) {
+			color[c] = Lerp(Gather(ctx.colormap + c, u0), Gather(ctx.colormap + c, u1), wu);
+		}
+		if (ctx.use_normal_color) {
+			color[0] = volume_data[0];
+			color[1] = volume_data[1];
+			color[2] = volume_data[2];
+		}
+
+		if (ctx.use_lighting) {
+			// PhongShading() in ray_casting.frag
+			const Float normal_length = Sqrt(Max(volume_data[0] * volume_data[0] + volume_data[1] * volume_data[1] + volume_data[2] * volume_data[2], Float(1e-20f)));
+			Float norm_x = volume_data[0] / normal_length, norm_y = volume_data[1] / normal_length, norm_z = volume_data[2] / normal_length;
+
+			Float light_x = Float(ctx.light_position.x) - pos_x, light_y = Float(ctx.light_position.y) - pos_y, light_z = Float(ctx.light_position.z) - pos_z;
+			const Float light_length = Sqrt(light_x * light_x + light_y * light_y + light_z * light_z);
+			light_x = light_x / light_length;
+			light_y = light_y / light_length;
+			light_z = light_z / light_length;
+
+			Float diff = norm_x * light_x + norm_y * light_y + norm_z * light_z;
+			const Float flip = Select(diff <= zero, Float(-1.0f), one);
+			diff = diff * flip;
+			norm_x = norm_x * flip;
+			norm_y = norm_y * flip;
+			norm_z = norm_z * flip;
+
+			Float view_x = Float(ctx.view_position.x) - pos_x, view_y = Float(ctx.view_position.y) - pos_y, view_z = Float(ctx.view_position.z) - pos_z;
+			const Float view_length = Sqrt(view_x * view_x + view_y * view_y + view_z * view_z);
+			view_x = view_x / view_length;
+			view_y = view_y / view_length;
+			view_z = view_z / view_length;
+
+			// reflect(-L, N) = 2 * dot(N, L) * N - L
+			const Float two_diff = diff + diff;
+			const Float reflect_x = two_diff * norm_x - light_x;
+			const Float reflect_y = two_diff * norm_y - light_y;
+			const Float reflect_z = two_diff * norm_z - light_z;
+			Float spec = Max(view_x * reflect_x + view_y * reflect_y + view_z * reflect_z, zero);
+			for (int i = 0; i < 6; i++) {
+				spec = spec * spec;	// pow(spec, 64)
+			}
+
+			const Float intensity = Float(0.1f) + diff + Float(0.5f) * spec;
+			color[0] = Min(Max(intensity * Float(ctx.light_color.x) * color[0], zero), one);
+			color[1] = Min(Max(intensity * Float(ctx.light_color.y) * color[1], zero), one);
+			color[2] = Min(Max(intensity * Float(ctx.light_color.z) * color[2], zero), one);
+		}
+
+		Float alpha = color[3];
+		Float ray_step = step;
+		if (ctx.use_adaptive_step) {
+			const Float gradient = Sqrt(volume_data[0] * volume_data[0] + volume_data[1] * volume_data[1] + volume_data[2] * volume_data[2]);
+			const Mask is_fine = fine_gradient < gradient;
+			const Mask is_coarse = (alpha < empty_alpha) & (gradient < smooth_gradient);
+			const Mask is_medium = (alpha < low_alpha) & (gradient < low_gradient);
+			ray_step = step * Select(is_fine, half, Select(is_coarse, four, Select(is_medium, two, one)));
+
+			// 1 - (1 - alpha)^(step / sample_rate), the ratio is a power of two so sqrt and squares are enough
+			const Float transparency = one - alpha;
+			const Float squared = transparency * transparency;
+			alpha = one - Select(is_fine, Sqrt(transparency), Select(is_coarse, squared * squared, Select(is_medium, squared, transparency)));
+		}
+
+		// Front-to-back compositing
+		const Float weight = Select(active, (one - result_a) * alpha, zero);
+		result_r = result_r + weight * color[0];
+		result_g = result_g + weight * color[1];
+		result_b = result_b + weight * color[2];
+		result_a = result_a + weight;
+
+		t = t + ray_step;
+		active = active & (result_a <= Float(0.99f)) & (t <= t_far);
+	}
+
+	alignas(32) float out[5][Width];
+	Store(out[0], result_r);
+	Store(out[1], result_g);
+	Store(out[2], result_b);
+	Store(out[3], result_a);
+	Store(out[4], samples);
+	size_t sample_count = 0;
+	for (int i = 0; i < count; i++) {
+		results[i * 4 + 0] = out[0][i];
+		results[i * 4 + 1] = out[1][i];
+		results[i * 4 + 2] = out[2][i];
+		results[i * 4 + 3] = out[3][i];
+		sample_count += static_cast<size_t>(out[4][i]);
+	}
+	return sample_count;
+}
+
+#ifdef ENABLE_AVX2_KERNEL
+// Defined in CpuRayCasterAVX2.cpp, which is the only file compiled with AVX2 enabled.
+size_t TraceRayPacketAvx2(const RayCastContext& ctx, const CpuRay* rays, const float* ray_t_near, const float* ray_t_far, int count, float* results);
+#endif
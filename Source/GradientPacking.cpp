@@ -0,0 +1,213 @@
+#include "GradientPacking.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <type_traits>
+
+namespace {
+	glm::vec2 SignNotZero(const glm::vec2& v) {
+		return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	template<typename T>
+	T Quantize(float value) {
+		const float max_value = static_cast<float>(std::numeric_limits<T>::max());
+		return static_cast<T>(std::clamp(value, 0.0f, 1.0f) * max_value + 0.5f);
+	}
+
+	template<typename T>
+	float Dequantize(T value) {
+		return static_cast<float>(value) / static_cast<float>(std::numeric_limits<T>::max());
+	}
+
+	// Plain rounding of both components can be off by one step, try the four neighbours and keep the closest.
+	template<typename T>
+	void EncodeNormal(const glm::vec3& normal, T* out) {
+		const float max_value = static_cast<float>(std::numeric_limits<T>::max());
+		const glm::vec2 scaled = (OctahedralEncode(normal) * 0.5f + glm::vec2(0.5f)) * max_value;
+		const glm::vec2 base = glm::floor(scaled);
+
+		float best_dot = -2.0f;
+		for (int j = 0; j < 2; j++) {
+			for (int i = 0; i < 2; i++) {
+				const glm::vec2 candidate = glm::clamp(base + glm::vec2(i, j), glm::vec2(0.0f), glm::vec2(max_value));
+				const float dot = glm::dot(OctahedralDecode(candidate / max_value * 2.0f - glm::vec2(1.0f)), normal);
+				if (dot > best_dot) {
+					best_dot = dot;
+					out[0] = static_cast<T>(candidate.x);
+					out[1] = static_cast<T>(candidate.y);
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	glm::vec4 DecodeVoxel(const T* gradients, const T* values, size_t index, float magnitude_scale) {
+		const T* gradient = gradients + index * 3;
+		const glm::vec3 normal = OctahedralDecode(glm::vec2(Dequantize(gradient[0]), Dequantize(gradient[1])) * 2.0f - glm::vec2(1.0f));
+		return glm::vec4(normal * Dequantize(gradient[2]) * magnitude_scale, Dequantize(values[index]));
+	}
+
+	// Every kMeasureStride-th cell along each axis is checked, at kMeasureSamples random positions
+	const int kMeasureStride = 2;
+	const int kMeasureSamples = 2;
+	// Below this fraction of the longest gradient the direction is mostly quantization noise of the magnitude,
+	// and such voxels are nearly flat and barely shaded anyway
+	const float kMeasureMinMagnitude = 0.05f;
+	// Angular error bounds the quantization has to stay within at interpolated positions
+	const double kMaxDegrees8 = 2.0;
+	const double kMaxDegrees16 = 0.02;
+}
+
+glm::vec2 OctahedralEncode(const glm::vec3& normal) {
+	const glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	if (n.z >= 0.0f) {
+		return glm::vec2(n.x, n.y);
+	}
+	return (glm::vec2(1.0f) - glm::abs(glm::vec2(n.y, n.x))) * SignNotZero(glm::vec2(n.x, n.y));
+}
+
+glm::vec3 OctahedralDecode(const glm::vec2& encoded) {
+	glm::vec3 n(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	const float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+glm::vec4 PackedGradients::Decode(size_t index) const {
+	if (component_bytes == 2) {
+		return DecodeVoxel(reinterpret_cast<const uint16_t*>(gradients.data()), reinterpret_cast<const uint16_t*>(values.data()), index, magnitude_scale);
+	}
+	return DecodeVoxel(gradients.data(), values.data(), index, magnitude_scale);
+}
+
+std::shared_ptr<PackedGradients> PackGradients(const RawVolume& volume, float max_gradient, GradientEncoding encoding, TaskScheduler& scheduler) {
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	auto packed = std::make_shared<PackedGradients>();
+	packed->encoding = encoding;
+	packed->resolution = volume.GetResolution();
+	packed->component_bytes = encoding == GRADIENT_ENCODING_OCT16 ? 2 : 1;
+	const glm::ivec3& res = packed->resolution;
+
+	const size_t voxel_count = volume.GetVoxelCount();
+	packed->gradients.assign(voxel_count * 3 * packed->component_bytes, 0);
+	packed->values.assign(voxel_count * packed->component_bytes, 0);
+
+	// The magnitude is stored relative to the longest gradient so the whole range is used
+	std::vector<float> slice_max(res.z, 0.0f);
+	scheduler.ParallelFor(res.z, [&](size_t z) {
+		for (int y = 0; y < res.y; y++) {
+			for (int x = 0; x < res.x; x++) {
+				slice_max[z] = std::max(slice_max[z], glm::length(volume.FetchGradient(x, y, static_cast<int>(z), max_gradient)));
+			}
+		}
+	});
+	const float max_magnitude = res.z > 0 ? *std::max_element(slice_max.begin(), slice_max.end()) : 0.0f;
+	packed->magnitude_scale = max_magnitude > 0.0f ? max_magnitude : 1.0f;
+
+	auto pack_slice = [&](auto* gradient_out, auto* value_out, size_t z) {
+		using T = std::remove_pointer_t<decltype(gradient_out)>;
+		size_t index = z * res.x * res.y;
+		for (int y = 0; y < res.y; y++) {
+			for (int x = 0; x < res.x; x++, index++) {
+				const glm::vec3 gradient = volume.FetchGradient(x, y, static_cast<int>(z), max_gradient);
+				const float magnitude = glm::length(gradient);
+				EncodeNormal(magnitude > 0.0f ? gradient / magnitude : glm::vec3(0.0f, 0.0f, 1.0f), gradient_out + index * 3);
+				gradient_out[index * 3 + 2] = Quantize<T>(magnitude / packed->magnitude_scale);
+				value_out[index] = Quantize<T>(volume.GetValue(volume.Index(x, y, static_cast<int>(z))));
+			}
+		}
+	};
+	scheduler.ParallelFor(res.z, [&](size_t z) {
+		if (packed->component_bytes == 2) {
+			pack_slice(reinterpret_cast<uint16_t*>(packed->gradients.data()), reinterpret_cast<uint16_t*>(packed->values.data()), z);
+		} else {
+			pack_slice(packed->gradients.data(), packed->values.data(), z);
+		}
+	});
+
+	packed->error = MeasureAngularError(*packed, volume, max_gradient, scheduler);
+	const auto end = std::chrono::high_resolution_clock::now();
+	packed->pack_time = std::chrono::duration<float, std::milli>(end - start).count();
+	return packed;
+}
+
+GradientAngularError MeasureAngularError(const PackedGradients& packed, const RawVolume& volume, float max_gradient, TaskScheduler& scheduler) {
+	// The shader interpolates the decoded gradients of the 8 corners around a sample, so do the same at random positions
+	// inside the cells and compare with the trilinear float gradient, which is what GL_LINEAR gives on the float texture.
+	const glm::ivec3& res = packed.resolution;
+	const int slab_count = std::max(0, (res.z - 1 + kMeasureStride - 1) / kMeasureStride);
+
+	std::vector<GradientAngularError> slabs(slab_count);
+	scheduler.ParallelFor(slab_count, [&](size_t slab) {
+		GradientAngularError& error = slabs[slab];
+		const int z = static_cast<int>(slab) * kMeasureStride;
+		std::minstd_rand random(static_cast<unsigned int>(slab) + 1);
+		std::uniform_real_distribution<float> offset(0.0f, 1.0f);
+		double sum = 0.0;
+		for (int y = 0; y + 1 < res.y; y += kMeasureStride) {
+			for (int x = 0; x + 1 < res.x; x += kMeasureStride) {
+				glm::vec3 expected_corners[8];
+				glm::vec3 decoded_corners[8];
+				for (int i = 0; i < 8; i++) {
+					const int cx = x + (i & 1), cy = y + ((i >> 1) & 1), cz = z + ((i >> 2) & 1);
+					expected_corners[i] = volume.FetchGradient(cx, cy, cz, max_gradient);
+					decoded_corners[i] = glm::vec3(packed.Decode(volume.LinearIndex(cx, cy, cz)));
+				}
+				for (int sample = 0; sample < kMeasureSamples; sample++) {
+					const glm::vec3 f(offset(random), offset(random), offset(random));
+					glm::vec3 expected(0.0f), decoded(0.0f);
+					for (int i = 0; i < 8; i++) {
+						const float weight = ((i & 1) ? f.x : 1.0f - f.x) * (((i >> 1) & 1) ? f.y : 1.0f - f.y) * (((i >> 2) & 1) ? f.z : 1.0f - f.z);
+						expected += expected_corners[i] * weight;
+						decoded += decoded_corners[i] * weight;
+					}
+					const float magnitude = glm::length(expected);
+					if (magnitude < kMeasureMinMagnitude * packed.magnitude_scale || glm::length(decoded) == 0.0f) {
+						continue;
+					}
+					// acos() loses small angles to float rounding, atan2 of the cross and dot products keeps them
+					expected = expected / magnitude;
+					decoded = glm::normalize(decoded);
+					const double degrees = std::atan2(glm::length(glm::cross(expected, decoded)), glm::dot(expected, decoded)) * 180.0 / 3.14159265358979323846;
+					error.max_degrees = std::max(error.max_degrees, degrees);
+					sum += degrees;
+					error.samples++;
+				}
+			}
+		}
+		error.mean_degrees = sum;
+	});
+
+	GradientAngularError error;
+	double sum = 0.0;
+	for (const GradientAngularError& slab : slabs) {
+		error.max_degrees = std::max(error.max_degrees, slab.max_degrees);
+		error.samples += slab.samples;
+		sum += slab.mean_degrees;
+	}
+	error.mean_degrees = error.samples > 0 ? sum / error.samples : 0.0;
+	error.is_passed = error.max_degrees <= GetAngularErrorBound(packed.encoding);
+	return error;
+}
+
+double GetAngularErrorBound(GradientEncoding encoding) {
+	return encoding == GRADIENT_ENCODING_OCT16 ? kMaxDegrees16 : kMaxDegrees8;
+}
+
+const char* GetGradientEncodingName(GradientEncoding encoding) {
+	switch (encoding) {
+		case GRADIENT_ENCODING_FLOAT:
+			return "Float";
+		case GRADIENT_ENCODING_OCT8:
+			return "Octahedral 8-bit";
+		case GRADIENT_ENCODING_OCT16:
+			return "Octahedral 16-bit";
+	}
+	return "Unknown";
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "RawVolume.h"
+#include "TaskScheduler.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// How the ray caster gets its gradients.
+enum GradientEncoding {
+	GRADIENT_ENCODING_FLOAT,	// rgb of the engine's volume texture
+	GRADIENT_ENCODING_OCT8,		// 2 x 8-bit octahedral normal, 8-bit magnitude and 8-bit value
+	GRADIENT_ENCODING_OCT16,	// 2 x 16-bit octahedral normal, 16-bit magnitude and 16-bit value
+};
+
+// Octahedral mapping between unit vectors and [-1, 1]^2, same as OctahedralDecode() in ray_casting.frag.
+glm::vec2 OctahedralEncode(const glm::vec3& normal);
+glm::vec3 OctahedralDecode(const glm::vec2& encoded);
+
+// Angle between the decoded and the float gradients at interpolated positions, see MeasureAngularError().
+struct GradientAngularError {
+	double max_degrees = 0.0;
+	double mean_degrees = 0.0;
+	size_t samples = 0;
+	bool is_passed = false;
+};
+
+// The gradients of a RawVolume packed as an octahedral normal plus a magnitude, and the value on its own.
+// Everything is x-major like the .raw file (RawVolume::LinearIndex()) with component_bytes per component.
+struct PackedGradients {
+	GradientEncoding encoding = GRADIENT_ENCODING_OCT8;
+	glm::ivec3 resolution = glm::ivec3(0);
+	size_t component_bytes = 1;
+	// Gradient length that a stored magnitude of 1 stands for
+	float magnitude_scale = 1.0f;
+	// 3 components per voxel: the octahedral normal and the magnitude
+	std::vector<uint8_t> gradients;
+	// 1 component per voxel
+	std::vector<uint8_t> values;
+	GradientAngularError error;
+	float pack_time = 0.0f;
+
+	// (gradient, value) of one voxel, like the float volume texture
+	glm::vec4 Decode(size_t index) const;
+};
+
+// Pack and measure, the scheduler runs both over the slices.
+std::shared_ptr<PackedGradients> PackGradients(const RawVolume& volume, float max_gradient, GradientEncoding encoding, TaskScheduler& scheduler);
+// Interpolate the decoded gradients of the 8 corners around random positions, the way ray_casting.frag does,
+// and compare with the trilinear float gradient. Passed if the largest angle is within GetAngularErrorBound().
+GradientAngularError MeasureAngularError(const PackedGradients& packed, const RawVolume& volume, float max_gradient, TaskScheduler& scheduler);
+double GetAngularErrorBound(GradientEncoding encoding);
+const char* GetGradientEncodingName(GradientEncoding encoding);
@@ -0,0 +1,223 @@
+#include "IlluminationVolume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+IlluminationVolume::~IlluminationVolume() {
+	if (pending.valid()) {
+		pending.wait();
+	}
+	glDeleteTextures(1, &texture);
+}
+
+void IlluminationVolume::Update(const std::shared_ptr<const RawVolume>& volume, const std::vector<float>& colormap, const glm::vec3& light_position, const glm::vec3& volume_size, StreamingUploader& uploader) {
+	if (!volume || volume->GetVoxelCount() == 0 || colormap.empty()) {
+		return;
+	}
+
+	// Finished? Upload it and keep the downsampled values for the next sweep. A result of an older volume is dropped.
+	if (pending.valid() && pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		Result result = pending.get();
+		if (result.volume_version == volume_version) {
+			values = result.values;
+			uploader.Cancel(texture);
+			uploader.QueueTexture3D(texture, resolution.x, resolution.y, resolution.z, GL_RED, GL_FLOAT, sizeof(float), result.light->data(), result.light);
+			has_result = true;
+		}
+	}
+
+	if (volume->GetVersion() != volume_version) {
+		// A computation of the previous volume may still run, it is not waited for
+		volume_version = volume->GetVersion();
+		source = volume;
+		values = nullptr;
+		uploader.Cancel(texture);
+		resolution = (volume->GetResolution() + glm::ivec3(downsample - 1)) / downsample;
+		if (texture == 0) {
+			glGenTextures(1, &texture);
+		}
+		glBindTexture(GL_TEXTURE_3D, texture);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, resolution.x, resolution.y, resolution.z, 0, GL_RED, GL_FLOAT, nullptr);
+		glBindTexture(GL_TEXTURE_3D, 0);
+		has_result = false;
+		is_dirty = true;
+	}
+
+	const glm::vec3 light = (light_position / volume_size + glm::vec3(0.5f)) * glm::vec3(resolution) - glm::vec3(0.5f);
+	// The light follows the camera, so an orbit moves it every frame. The last result is kept (stale) while it moves
+	// and the sweep is redone once it has been still for kLightSettleTime.
+	const auto now = std::chrono::steady_clock::now();
+	if (light != moving_light) {
+		moving_light = light;
+		light_moved_at = now;
+	}
+	// Moving the light by less than a reduced voxel does not change the result visibly
+	is_light_stale = glm::length(light - last_light) > 1.0f;
+	if ((is_light_stale && now - light_moved_at >= kLightSettleTime) || colormap != last_colormap || density != last_density) {
+		is_dirty = true;
+	}
+	if (!is_dirty || pending.valid()) {
+		return;
+	}
+
+	last_light = light;
+	is_light_stale = false;
+	last_colormap = colormap;
+	last_density = density;
+	is_dirty = false;
+
+	Input input{ source, values, resolution, colormap, light, density };
+	pending = std::async(std::launch::async, [this, input]() { return Compute(input); });
+}
+
+std::shared_ptr<const std::vector<float>> IlluminationVolume::Downsample(const RawVolume& volume, const glm::ivec3& reduced_resolution) {
+	// Reduced voxel i covers [i, i + 1] / reduced_resolution in texture space, the same cell the GPU samples it at.
+	// It is averaged from downsample^3 trilinear samples inside that cell, so odd resolutions do not shift the grid.
+	const glm::ivec3& res = reduced_resolution;
+	auto downsampled = std::make_shared<std::vector<float>>(static_cast<size_t>(res.x) * res.y * res.z);
+	scheduler.ParallelFor(res.z, [&](size_t z) {
+		for (int y = 0; y < res.y; y++) {
+			for (int x = 0; x < res.x; x++) {
+				float sum = 0.0f;
+				for (int dz = 0; dz < downsample; dz++) {
+					for (int dy = 0; dy < downsample; dy++) {
+						for (int dx = 0; dx < downsample; dx++) {
+							const glm::vec3 cell = glm::vec3(x, y, static_cast<float>(z)) + (glm::vec3(dx, dy, dz) + glm::vec3(0.5f)) / static_cast<float>(downsample);
+							sum += volume.Sample(cell / glm::vec3(res));
+						}
+					}
+				}
+				(*downsampled)[(z * res.y + y) * res.x + x] = sum / (downsample * downsample * downsample);
+			}
+		}
+	});
+	return downsampled;
+}
+
+IlluminationVolume::Result IlluminationVolume::Compute(const Input& input) {
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const glm::ivec3 res = input.resolution;
+	const size_t voxel_count = static_cast<size_t>(res.x) * res.y * res.z;
+	auto index = [&res](const glm::ivec3& p) {
+		return (static_cast<size_t>(p.z) * res.y + p.y) * res.x + p.x;
+	};
+	const std::shared_ptr<const std::vector<float>> reduced = input.values ? input.values : Downsample(*input.volume, res);
+
+	// Opacity of one reduced voxel, a reduced voxel spans `downsample` voxels of the original volume
+	const int colormap_size = static_cast<int>(input.colormap.size() / 4);
+	std::vector<float> transparency(voxel_count);
+	scheduler.ParallelFor(res.z, [&](size_t z) {
+		const size_t begin = z * res.x * res.y;
+		for (size_t i = begin; i < begin + static_cast<size_t>(res.x) * res.y; i++) {
+			// Linear between the two nearest entries, like the colormap texture the ray caster samples
+			const float position = std::clamp((*reduced)[i], 0.0f, 1.0f) * (colormap_size - 1);
+			const int low = std::min(static_cast<int>(position), colormap_size - 1);
+			const int high = std::min(low + 1, colormap_size - 1);
+			const float alpha = glm::mix(input.colormap[low * 4 + 3], input.colormap[high * 4 + 3], position - low);
+			transparency[i] = std::pow(1.0f - alpha, input.density * downsample);
+		}
+	});
+
+	auto light = std::make_shared<std::vector<float>>(voxel_count, 1.0f);
+
+	// Light leaving the slice `slice` of axis towards (u, v), bilinear, 1 outside the volume.
+	// The sweep runs by distance from the light, so when the next slice is computed only the voxels nearer to the light
+	// than it are finished: on this slice the square |offset| < distance around the light, the rest may still be at 1.
+	// Corners outside that square, which belong to pyramids that have not got that far yet, are clamped into it.
+	auto transmitted = [&](int axis, int slice, float u, float v) {
+		const int u_axis = (axis + 1) % 3, v_axis = (axis + 2) % 3;
+		const float distance = std::abs(slice - input.light[axis]) + 1.0f;
+		const int min_u = static_cast<int>(std::floor(input.light[u_axis] - distance)) + 1;
+		const int max_u = static_cast<int>(std::ceil(input.light[u_axis] + distance)) - 1;
+		const int min_v = static_cast<int>(std::floor(input.light[v_axis] - distance)) + 1;
+		const int max_v = static_cast<int>(std::ceil(input.light[v_axis] + distance)) - 1;
+		const float fu = std::floor(u), fv = std::floor(v);
+		const float wu = u - fu, wv = v - fv;
+		float sum = 0.0f;
+		for (int j = 0; j < 2; j++) {
+			for (int i = 0; i < 2; i++) {
+				const float weight = (i ? wu : 1.0f - wu) * (j ? wv : 1.0f - wv);
+				const int cu = std::clamp(static_cast<int>(fu) + i, min_u, max_u);
+				const int cv = std::clamp(static_cast<int>(fv) + j, min_v, max_v);
+				if (cu < 0 || cv < 0 || cu >= res[u_axis] || cv >= res[v_axis]) {
+					sum += weight;
+					continue;
+				}
+				glm::ivec3 p;
+				p[axis] = slice;
+				p[u_axis] = cu;
+				p[v_axis] = cv;
+				const size_t id = index(p);
+				sum += weight * (*light)[id] * transparency[id];
+			}
+		}
+		return sum;
+	};
+
+	// The light may be inside the volume, so sweep outward from it in both directions of every axis.
+	// That splits the volume into six pyramids with their apex at the light. A voxel belongs to the pyramid of the axis
+	// its offset from the light is largest along, and the point it reads on the previous slice lies on the same ray,
+	// so in the same pyramid; the bilinear footprint and the blur around it are kept to finished voxels by transmitted().
+	// The slices of all pyramids run nearest to the light first.
+	struct SweepSlice {
+		int axis;
+		int direction;
+		int slice;
+		float distance;
+	};
+	std::vector<SweepSlice> sweep;
+	for (int axis = 0; axis < 3; axis++) {
+		for (int slice = std::max(0, static_cast<int>(std::floor(input.light[axis])) + 1); slice < res[axis]; slice++) {
+			sweep.push_back({ axis, 1, slice, slice - input.light[axis] });
+		}
+		for (int slice = std::min(res[axis] - 1, static_cast<int>(std::ceil(input.light[axis])) - 1); slice >= 0; slice--) {
+			sweep.push_back({ axis, -1, slice, input.light[axis] - slice });
+		}
+	}
+	std::stable_sort(sweep.begin(), sweep.end(), [](const SweepSlice& a, const SweepSlice& b) { return a.distance < b.distance; });
+
+	for (const SweepSlice& current : sweep) {
+		const int axis = current.axis;
+		const int u_axis = (axis + 1) % 3, v_axis = (axis + 2) % 3;
+		const int previous = current.slice - current.direction;
+		// Nothing between the light and this slice if the previous one is behind the light or outside the volume
+		const bool is_first = previous < 0 || previous >= res[axis] || (previous - input.light[axis]) * current.direction <= 0.0f;
+		scheduler.ParallelFor(res[v_axis], [&](size_t v) {
+			glm::ivec3 p;
+			p[axis] = current.slice;
+			p[v_axis] = static_cast<int>(v);
+			for (p[u_axis] = 0; p[u_axis] < res[u_axis]; p[u_axis]++) {
+				const glm::vec3 ray = glm::vec3(p) - input.light;
+				if (std::abs(ray[axis]) < std::abs(ray[u_axis]) || std::abs(ray[axis]) < std::abs(ray[v_axis])) {
+					continue;	// another pyramid
+				}
+				if (is_first) {
+					(*light)[index(p)] = 1.0f;
+					continue;
+				}
+
+				// Follow the ray from the light back to the previous slice
+				const float t = 1.0f / std::abs(ray[axis]);
+				const float u = p[u_axis] - ray[u_axis] * t;
+				const float w = p[v_axis] - ray[v_axis] * t;
+
+				// A little blur from the neighbours gives soft shadows
+				const float direct = transmitted(axis, previous, u, w);
+				const float soft = (transmitted(axis, previous, u - 1.0f, w) + transmitted(axis, previous, u + 1.0f, w)
+					+ transmitted(axis, previous, u, w - 1.0f) + transmitted(axis, previous, u, w + 1.0f)) * 0.25f;
+				(*light)[index(p)] = direct * 0.6f + soft * 0.4f;
+			}
+		});
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	last_compute_time = std::chrono::duration<float, std::milli>(end - start).count();
+	return Result{ input.volume->GetVersion(), reduced, light };
+}
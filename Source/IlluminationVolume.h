@@ -0,0 +1,85 @@
+#pragma once
+
+#include "RawVolume.h"
+#include "StreamingUploader.h"
+#include "TaskScheduler.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+
+// Light reaching every voxel from the point light, attenuated by the opacity the transfer function gives the volume.
+// Computed on the CPU at a reduced resolution by sweeping slices away from the light, and sampled by ray_casting.frag
+// so shadows cost one texture fetch per sample.
+// Everything runs in a background task on its own scheduler, so the render thread only starts it and uploads the result.
+// Only the sweep is redone when the transfer function or the light changes, the downsampled values are kept.
+// A moving light only marks the result stale, it is recomputed once the light stops.
+class IlluminationVolume {
+public:
+	static constexpr std::chrono::milliseconds kLightSettleTime{ 250 };
+
+	// scheduler should not be the one the render thread uses, ParallelFor runs one job at a time.
+	explicit IlluminationVolume(TaskScheduler& scheduler, int downsample = 2) : scheduler(scheduler), downsample(downsample) {}
+	~IlluminationVolume();
+
+	IlluminationVolume(const IlluminationVolume&) = delete;
+	IlluminationVolume& operator=(const IlluminationVolume&) = delete;
+
+	// Cheap to call every frame: starts a background recompute when something changed and uploads finished results.
+	void Update(const std::shared_ptr<const RawVolume>& volume, const std::vector<float>& colormap, const glm::vec3& light_position, const glm::vec3& volume_size, StreamingUploader& uploader);
+
+	void SetDensity(float value) { density = value; }
+	float* DensityHelper() { return &density; }
+	GLuint GetTexture() const { return has_result ? texture : 0; }
+	const glm::ivec3& GetResolution() const { return resolution; }
+	float GetLastComputeTime() const { return last_compute_time; }
+	bool IsComputing() const { return pending.valid(); }
+	// The light has moved since the texture was computed and is waiting to settle
+	bool IsStale() const { return is_light_stale; }
+
+private:
+	struct Input {
+		std::shared_ptr<const RawVolume> volume;
+		std::shared_ptr<const std::vector<float>> values;	// null until the volume has been downsampled
+		glm::ivec3 resolution;
+		std::vector<float> colormap;
+		glm::vec3 light;		// in reduced voxel coordinates
+		float density;
+	};
+	struct Result {
+		size_t volume_version;
+		std::shared_ptr<const std::vector<float>> values;
+		std::shared_ptr<const std::vector<float>> light;
+	};
+
+	std::shared_ptr<const std::vector<float>> Downsample(const RawVolume& volume, const glm::ivec3& reduced_resolution);
+	Result Compute(const Input& input);
+
+	TaskScheduler& scheduler;
+	int downsample;
+	float density = 1.0f;
+
+	// Inputs of the last computation, compared every frame
+	size_t volume_version = 0;
+	std::shared_ptr<const RawVolume> source;
+	std::shared_ptr<const std::vector<float>> values;
+	glm::ivec3 resolution = glm::ivec3(0);
+	std::vector<float> last_colormap;
+	glm::vec3 last_light = glm::vec3(0.0f);
+	glm::vec3 moving_light = glm::vec3(0.0f);
+	std::chrono::steady_clock::time_point light_moved_at;
+	bool is_light_stale = false;
+	float last_density = -1.0f;
+	bool is_dirty = true;
+
+	std::future<Result> pending;
+	std::atomic<float> last_compute_time{ 0.0f };
+
+	GLuint texture = 0;
+	bool has_result = false;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ChunkArena.h"
+#include "RawVolume.h"
+#include "TaskScheduler.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Interleaved like the engine's vertex buffer: location 0 is the position, location 1 the normal.
+struct IsoVertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+// Extracts the iso surface of a RawVolume as a triangle list with marching cubes, like IsoSurface::ConvertToPolygon().
+// A count pass finds the number of triangles of every z slab and pre-sizes the arena, then every active slab gets
+// its own block from the arena's chunks and the slabs are filled in parallel. The chunks are reused by the next
+// Extract(), so changing the iso value again and again does not go back to the heap unless the surface gets larger.
+class IsoSurfaceExtractor {
+public:
+	struct Stats {
+		size_t triangle_count = 0;
+		size_t active_slabs = 0;	// z slabs with at least one triangle
+		float count_time = 0.0f;
+		float fill_time = 0.0f;
+	};
+
+	// Vertices of one slab, first_vertex is where they go in a single vertex buffer holding the whole surface
+	struct Block {
+		const IsoVertex* vertices;
+		size_t first_vertex;
+		size_t vertex_count;
+	};
+
+	explicit IsoSurfaceExtractor(TaskScheduler& scheduler) : scheduler(scheduler) {}
+
+	// iso_value is in [0, 255] like the engine's. Positions are in voxels times the ratio, voxel centers at (i + 0.5) * ratio,
+	// normals point from high to low values. The previous output is invalid after this call.
+	void Extract(const RawVolume& volume, float iso_value);
+	// Drop the output and give the arena back to the heap.
+	void Clear();
+
+	// In vertex buffer order
+	const std::vector<Block>& GetBlocks() const { return blocks; }
+	size_t GetVertexCount() const { return stats.triangle_count * 3; }
+	const Stats& GetStats() const { return stats; }
+	const ChunkArena::Stats& GetArenaStats() const { return arena.GetStats(); }
+
+	// Log the output size and the arena counters, next to IsoSurface::Debug().
+	void Debug() const;
+
+private:
+	TaskScheduler& scheduler;
+	ChunkArena arena;
+	std::vector<Block> blocks;
+	std::vector<size_t> slab_offsets;
+	Stats stats;
+};
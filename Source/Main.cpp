@@ -10,6 +10,17 @@
 #include "Light.h"
 #include "NDCQuad.h"
 #include "Sphere.h"
+#include "TaskScheduler.h"
+#include "VolumeData.h"
+#include "CpuIsoRenderer.h"
+#include "CpuRayCaster.h"
+#include "IsoSurfaceExtractor.h"
+#include "StreamingUploader.h"
+#include "VolumeSequence.h"
+#include "IlluminationVolume.h"
+#include "PackedGradientVolume.h"
+#include "SliceRenderer.h"
+#include "RenderServer.h"
 
 #include <stb_image.h>
 #include <imgui.h>
@@ -18,7 +29,12 @@
 #include <imgui_impl_opengl3.h>
 #include <implot.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <future>
 #include <random>
+#include <thread>
 #include <transfer_function_widget.h>
 
 class VolumeRendering final : public Nexus::Application {
@@ -73,40 +89,140 @@ public:
 		quad = std::make_unique<Nexus::NDCQuad>();
 		sphere = std::make_unique<Nexus::Sphere>();
 
+		// Create CPU renderers
+		scheduler = std::make_unique<TaskScheduler>();
+		cpu_iso_renderer = std::make_unique<CpuIsoRenderer>(*scheduler);
+		cpu_ray_caster = std::make_unique<CpuRayCaster>(*scheduler);
+		iso_extractor = std::make_unique<IsoSurfaceExtractor>(*scheduler);
+		uploader = std::make_unique<StreamingUploader>();
+		sequence = std::make_unique<VolumeSequence>();
+		sequence->SetLayout(volume_layout);
+		// Work that may take longer than a frame runs on its own, smaller pool so it never holds the render thread's ParallelFor
+		background_scheduler = std::make_unique<TaskScheduler>(std::max(1u, std::thread::hardware_concurrency() / 2));
+		illumination = std::make_unique<IlluminationVolume>(*background_scheduler);
+		packed_gradients = std::make_unique<PackedGradientVolume>(*background_scheduler);
+		slice_renderer = std::make_unique<SliceRenderer>(*scheduler);
+		render_server = std::make_unique<RenderServer>(std::max(1u, std::thread::hardware_concurrency() / 2));
+		slice_views[0].request.axis = SLICE_AXIS_X;
+		slice_views[1].request.axis = SLICE_AXIS_Y;
+		slice_views[2].request.axis = SLICE_AXIS_Z;
+
 		// Create a transfunction (1D Texture)
 		transfer_function_texture = GetTFTexture(tf_widget);
 
 		// Create a point light
 		point_light = std::make_unique<Nexus::PointLight>(glm::vec3(0.0f, 0.0f, 0.0f), true);
 
-		// Create a texture color buffer (texture 2D)
-		texture_color_buffer = std::make_unique<Nexus::Texture2D>(Settings.Width, Settings.Height, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
+		// Create Framebuffer, the texture color buffer (texture 2D) and depth buffer are sized to the window in ResizeFramebuffer().
+		// A lower render scale only uses a corner of it, so changing the scale never reallocates anything.
+		glGenFramebuffers(1, &framebuffer);
+		glGenRenderbuffers(1, &rbo);
+		ResizeFramebuffer(Settings.Width, Settings.Height);
+		// glDeleteFramebuffers(1, &framebuffer);
+	}
+
+	void ResizeFramebuffer(int width, int height) {
+		if (texture_color_buffer != nullptr && width == framebuffer_width && height == framebuffer_height) {
+			return;
+		}
+		framebuffer_width = width;
+		framebuffer_height = height;
+
+		texture_color_buffer = std::make_unique<Nexus::Texture2D>(width, height, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
 		texture_color_buffer->SetFilterParams(GL_LINEAR, GL_LINEAR);
 		texture_color_buffer->SetWrappingParams(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
 
-		// Create Framebuffer and bind the texture
-		glGenFramebuffers(1, &framebuffer);
 		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_color_buffer->ID, 0);
 
-		glGenRenderbuffers(1, &rbo);
 		glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Settings.Width, Settings.Height);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
 		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
 		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 			// error
 			std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 		}
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		// glDeleteFramebuffers(1, &framebuffer);
+	}
+
+	// Nudge the render scale so the frame time stays around the target.
+	// The scale moves in fixed steps and then holds for a while, so the frame time of the new scale is measured
+	// before the next decision and the scale does not flicker between two steps.
+	void AdjustRenderScale() {
+		const float frame_time = ImGui::GetIO().DeltaTime * 1000.0f;
+		smoothed_frame_time = smoothed_frame_time * 0.9f + frame_time * 0.1f;
+		if (render_scale_hold > 0) {
+			render_scale_hold--;
+			return;
+		}
+		float next_scale = render_scale;
+		if (smoothed_frame_time > target_frame_time * 1.1f) {
+			next_scale = render_scale - kRenderScaleStep;
+		} else if (smoothed_frame_time < target_frame_time * 0.8f) {
+			next_scale = render_scale + kRenderScaleStep;
+		}
+		next_scale = std::clamp(std::round(next_scale / kRenderScaleStep) * kRenderScaleStep, 0.25f, 1.0f);
+		if (next_scale != render_scale) {
+			render_scale = next_scale;
+			render_scale_hold = kRenderScaleHoldFrames;
+		}
 	}
 
 	void Update() override {
+		// 每個 frame 只上傳一部分資料，避免一次上傳卡住畫面
+		sequence->Update(DeltaTime, *uploader);
+		uploader->Update();
 
+		if (render_server->IsRunning()) {
+			UpdateRenderServerVolume();
+		}
+	}
+
+	// Render server 的 volume 在背景直接從 raw 檔（或 sequence 解出來的那一格）建，不在 render thread 上讀回 texture。
+	// 建好之後才交給 server，server 在那之前繼續用舊的那份。
+	void UpdateRenderServerVolume() {
+		if (render_server_pending.valid() && render_server_pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			const std::shared_ptr<const VolumeData> built = render_server_pending.get();
+			if (built) {
+				render_server->SetVolume(built, render_server_size);
+			}
+		}
+
+		const std::shared_ptr<const RawVolume> raw = GetActiveRawVolume();
+		if (!raw) {
+			// Log once when the volume goes away, not every frame
+			if (!render_server_is_waiting) {
+				render_server_is_waiting = true;
+				Nexus::Logger::Message(Nexus::LOG_WARNING, "Render server: no volume data loaded, keeping the last volume.");
+			}
+			return;
+		}
+		render_server_is_waiting = false;
+
+		const ServerVolumeRequest request{ raw->GetVersion(), GetActiveMaxGradient(), volume_layout };
+		if (request == render_server_request || render_server_pending.valid()) {
+			return;
+		}
+		render_server_request = request;
+		render_server_size = glm::vec3(raw->GetResolution()) * raw->GetRatio();
+		render_server_pending = std::async(std::launch::async, [raw, request]() -> std::shared_ptr<const VolumeData> {
+			auto built = std::make_shared<VolumeData>();
+			if (!built->LoadFromRawVolume(*raw, request.max_gradient, request.layout)) {
+				return nullptr;
+			}
+			return built;
+		});
 	}
 
 	void Render(Nexus::DisplayMode monitor_type) override {
 
+		// 3O1P 的三個正交視窗改畫 CPU 切出來的切面
+		if (show_slice_views && Settings.CurrentDisplyMode == Nexus::DISPLAY_MODE_3O1P && monitor_type != Nexus::DISPLAY_MODE_DEFAULT
+			&& engine->GetIsInitialize() && engine->GetIsReadyToDraw()) {
+			DrawSliceView(monitor_type);
+			return;
+		}
+
 		SetViewMatrix(Nexus::DISPLAY_MODE_DEFAULT);
 		SetProjectionMatrix(Nexus::DISPLAY_MODE_DEFAULT);
 		SetViewport(Nexus::DISPLAY_MODE_DEFAULT);
@@ -135,23 +251,23 @@ public:
 		myShader->SetVec3("lightPos", point_light->GetPosition());
 		myShader->SetVec3("lightColor", point_light->GetDiffuse());
 		myShader->SetFloat("iso_value", iso_value);
-		myShader->SetBool("is_volume", false);
+		myShader->SetBool("is_volume", use_iso_lighting);
 
 		// ==================== Draw origin and 3 axes ====================
 
 
 		if (engine->GetCurrentRenderMode() == Nexus::RENDER_MODE_ISO_SURFACE) {
 			// Iso Surface
-			if (engine->GetIsInitialize() && engine->GetIsReadyToDraw()) {
+			if (engine->GetIsInitialize() && iso_draw_count > 0) {
 				model->Push();
 				model->Save(glm::translate(model->Top(), engine->GetResolution() * engine->GetRatio() * -0.5f));
 				myShader->SetVec3("objectColor", glm::vec3(0.482352941, 0.68627451, 0.929411765));
-				engine->Draw(myShader.get(), model->Top());
+				DrawIsoSurface(myShader.get(), model->Top());
 				if (Settings.NormalVisualize) {
 					normalShader->Use();
 					normalShader->SetMat4("view", view);
 					normalShader->SetMat4("projection", projection);
-					engine->Draw(normalShader.get(), model->Top());
+					DrawIsoSurface(normalShader.get(), model->Top());
 				}
 				model->Pop();
 			}
@@ -169,96 +285,94 @@ public:
 			rayShader->SetFloat("sample_rate", sample_rate);
 			rayShader->SetBool("useNormalColor", use_normal_color);
 			rayShader->SetBool("useLighting", use_lighting);
+			rayShader->SetBool("useAdaptiveStep", use_adaptive_step);
+			rayShader->SetFloat("boundaryGradient", boundary_gradient);
+			rayShader->SetFloat("adaptiveEmptyAlpha", kAdaptiveEmptyAlpha);
+			rayShader->SetFloat("adaptiveLowAlpha", kAdaptiveLowAlpha);
 
 			if (engine->GetIsInitialize() && engine->GetIsReadyToDraw()) {
+				// 光照體積在背景重新計算，算好之前先不用
+				if (use_illumination && GetActiveRawVolume()) {
+					illumination->Update(GetActiveRawVolume(), tf_widget.get_colormapf(), point_light->GetPosition(), engine->GetResolution() * engine->GetRatio(), *uploader);
+				}
+				rayShader->SetInt("illumination", 2);
+				rayShader->SetBool("useIllumination", use_illumination && illumination->GetTexture() != 0);
+
+				// 從 raw 檔的樣本在背景打包，不需要讀回 16 bytes/voxel 的 CPU 副本
+				if (gradient_encoding != GRADIENT_ENCODING_FLOAT) {
+					packed_gradients->Update(GetActiveRawVolume(), GetActiveMaxGradient(), gradient_encoding, *uploader);
+				}
+				UpdateEngineVolumeTexture();
+				// 切回 float 後，engine 的材質還原好之前繼續用打包的梯度
+				const bool use_packed_gradients = packed_gradients->GetGradientTexture() != 0 && (gradient_encoding != GRADIENT_ENCODING_FLOAT
+					|| (engine_texture_state != ENGINE_TEXTURE_RESIDENT && !sequence->IsOpen()));
+				rayShader->SetInt("packed_gradients", 3);
+				rayShader->SetInt("packed_values", 4);
+				rayShader->SetInt("gradientEncoding", use_packed_gradients ? packed_gradients->GetEncoding() : GRADIENT_ENCODING_FLOAT);
+				rayShader->SetFloat("gradientMagnitudeScale", packed_gradients->GetMagnitudeScale());
+
+				// 先在較低的解析度 ray casting 到 framebuffer，再放大畫回螢幕
+				GLint viewport[4];
+				glGetIntegerv(GL_VIEWPORT, viewport);
+				const bool use_offscreen = render_scale < 1.0f;
+				const int target_width = std::clamp(static_cast<int>(viewport[2] * render_scale), 1, framebuffer_width);
+				const int target_height = std::clamp(static_cast<int>(viewport[3] * render_scale), 1, framebuffer_height);
+				if (use_offscreen) {
+					// 只用 framebuffer 左下角 target_width x target_height 的區域
+					glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+					glViewport(0, 0, target_width, target_height);
+					glEnable(GL_SCISSOR_TEST);
+					glScissor(0, 0, target_width, target_height);
+					glClearColor(Settings.BackgroundColor.x, Settings.BackgroundColor.y, Settings.BackgroundColor.z, 1.0f);
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					glDisable(GL_SCISSOR_TEST);
+				}
+
 				model->Push();
 				model->Save(glm::translate(model->Top(), engine->GetResolution() * engine->GetRatio() * -0.5f));
 				//model->Save(glm::translate(model->Top(), glm::vec3(-149 / 2.0f, -208 / 2.0f, -110 / 2.0f)));
 				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_3D, engine->GetVolumeTexture());
+				glBindTexture(GL_TEXTURE_3D, GetActiveVolumeTexture());
 				glActiveTexture(GL_TEXTURE1);
 				glBindTexture(GL_TEXTURE_1D, transfer_function_texture);
-				engine->Draw(rayShader.get(), model->Top());
+				glActiveTexture(GL_TEXTURE2);
+				glBindTexture(GL_TEXTURE_3D, illumination->GetTexture());
+				glActiveTexture(GL_TEXTURE3);
+				glBindTexture(GL_TEXTURE_3D, packed_gradients->GetGradientTexture());
+				glActiveTexture(GL_TEXTURE4);
+				glBindTexture(GL_TEXTURE_3D, packed_gradients->GetValueTexture());
+				// engine 的 float 材質已經釋放、新的打包結果還沒上傳完的那幾個 frame 不畫
+				if (use_packed_gradients || engine_texture_state == ENGINE_TEXTURE_RESIDENT || sequence->IsOpen()) {
+					engine->Draw(rayShader.get(), model->Top());
+				}
 				model->Pop();
-			}
-
-
-
-			/*
-			// Frame buffer binding
-			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-			glEnable(GL_DEPTH_TEST);
-			glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-			
-			// Shader Init
-			entryExitShader->Use();
-			entryExitShader->SetMat4("view", view);
-			entryExitShader->SetMat4("projection", projection);
-
-			glDrawBuffer(GL_COLOR_ATTACHMENT1);
-			
-			// 設定 DepthFunc 為 GL_GREATER，代表距離比較遠的會蓋過距離比較近的物體。　（視覺上類似Front Face Culling）
-			glDepthFunc(GL_GREATER);
 
-			// 儲存當前的 GL_DEPTH_CLEAR_VALUE 值（這個是預設值 1.0f）
-			float old_depth;
-			glGetFloatv(GL_DEPTH_CLEAR_VALUE, &old_depth);
-			
-			// 設定為 0，如此一來深度值必須大於0(比較遠)才會畫出來，如果設 1.0f 什麼都畫不出來。 （因為GL_GREATER）
-			glClearDepth(0.0f);
-
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			if (engine->GetIsInitialize() && engine->GetIsReadyToDraw()) {
-				model->Push();
-				engine->Draw(entryExitShader.get(), model->Top());
-				model->Pop();
+				if (use_offscreen) {
+					glBindFramebuffer(GL_FRAMEBUFFER, 0);
+					glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+					glDisable(GL_DEPTH_TEST);
+					glDisable(GL_CULL_FACE);
+
+					screenShader->Use();
+					screenShader->SetInt("screen_texture", 0);
+					screenShader->SetInt("upsampling_mode", upsampling_mode);
+					screenShader->SetVec2("viewport_offset", glm::vec2(viewport[0], viewport[1]));
+					screenShader->SetVec2("viewport_size", glm::vec2(viewport[2], viewport[3]));
+					screenShader->SetVec2("source_size", glm::vec2(target_width, target_height));
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_2D, texture_color_buffer->ID);
+					quad->Draw(screenShader.get());
+
+					glEnable(GL_DEPTH_TEST);
+					if (Settings.EnableFaceCulling) {
+						glEnable(GL_CULL_FACE);
+					}
+				}
 			}
 
-			glDrawBuffer(GL_COLOR_ATTACHMENT0);
-			
-			// 設定 DepthFunc 為 GL_LESS，代表距離比較近的會蓋過距離比較遠的物體。
-			glDepthFunc(GL_LESS);
-
-			// 將 Depth Buffer 的預設值設回原本的預設 （也就是 1.0f） （因為現在是 GL_LESS，必須要小於1.0f才畫得出東西來）
-			glClearDepth(old_depth);
-			
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			if (engine->GetIsInitialize() && engine->GetIsReadyToDraw()) {
-				model->Push();
-				engine->Draw(entryExitShader.get(), model->Top());
-				model->Pop();
+			if (auto_render_scale) {
+				AdjustRenderScale();
 			}
-
-			screenShader->Use();
-			screenShader->SetInt("entry_points_sampler", 0);
-			screenShader->SetInt("exit_points_sampler", 1);
-			screenShader->SetInt("volume", 2);
-			screenShader->SetInt("transfer_function", 3);
-			screenShader->SetVec2("screen_size", glm::vec2(Settings.Width, Settings.Height));
-			screenShader->SetVec3("volume_resoultion", engine->GetResolution());
-			screenShader->SetFloat("sampling_rate", sampling_rate);
-			screenShader->SetVec3("viewPos", Settings.EnableGhostMode ? first_camera->GetPosition() : third_camera->GetPosition());
-			screenShader->SetVec3("lightPos", Settings.EnableGhostMode ? first_camera->GetPosition() : third_camera->GetPosition());
-			screenShader->SetVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-			
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			glDisable(GL_DEPTH_TEST);
-			glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, entry_points->ID);
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, exit_points->ID);
-
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_3D, engine->GetVolumeTexture());
-			glActiveTexture(GL_TEXTURE3);
-			glBindTexture(GL_TEXTURE_1D, transfer_function_texture);
-			
-			// Draw screen quad
-			quad->Draw(screenShader.get());
-			*/
 		}
 
         glDisable(GL_DEPTH_TEST);
@@ -362,8 +476,14 @@ public:
                         Nexus::Logger::Message(Nexus::LOG_ERROR, "Please select a folder path and choose a volume data first!");
                         ImGui::OpenPopup("Error##02");
                     } else {
-                        // 初始化
+                        // 初始化，engine 會重新建立它的 volume 材質
+                        ResetEngineVolumeTexture();
                         engine->Initialize(std::string(volume_data_folder_path) + "/" + current_item_inf, std::string(volume_data_folder_path) + "/" + current_item_raw, max_gradient);
+                        volume_max_gradient = max_gradient;
+                        volume_data = nullptr;
+                        LoadRawVolume(std::string(volume_data_folder_path) + "/" + current_item_inf, std::string(volume_data_folder_path) + "/" + current_item_raw);
+                        iso_extractor->Clear();
+                        iso_draw_count = 0;
 
                         iso_value_histogram = engine->GetIsoValueHistogram();
                         iso_value_histogram_max = *std::max_element(iso_value_histogram.cbegin(), iso_value_histogram.cend());
@@ -399,6 +519,112 @@ public:
                         ImGui::BulletText("DataType: %s", engine->GetDataType().c_str());
                         ImGui::BulletText("Endian: %s", engine->GetEndian().c_str());
                     }
+                    if (ImGui::CollapsingHeader("Time Series")) {
+                        // 把整個資料夾的 raw 檔當成時間序列播放（解析度要和目前載入的資料相同）
+                        if (ImGui::Button(sequence->IsOpen() ? "Close Sequence" : "Play Folder as Sequence")) {
+                            if (sequence->IsOpen()) {
+                                sequence->Close();
+                                volume_data = nullptr;
+                            } else if (sequence->Open(std::string(volume_data_folder_path), file_names_raw, file_names_inf, max_gradient)) {
+                                if (glm::vec3(sequence->GetInfo().resolution) != engine->GetResolution()) {
+                                    Nexus::Logger::Message(Nexus::LOG_WARNING, "Sequence: the resolution is different from the loaded volume data.");
+                                }
+                                sequence->SetPlaying(true);
+                            }
+                        }
+                        if (sequence->IsOpen() && glm::vec3(sequence->GetInfo().resolution) != engine->GetResolution()) {
+                            ImGui::TextColored(ImVec4(0.9f, 0.2f, 0.0f, 1.0f), "The sequence resolution differs from the loaded volume data.");
+                        }
+                        if (!sequence->GetSkippedFiles().empty()) {
+                            // 解析度或型態跟第一個 timestep 不同的檔案不會播放
+                            ImGui::TextColored(ImVec4(0.9f, 0.8f, 0.0f, 1.0f), "%zu files are not part of the sequence.", sequence->GetSkippedFiles().size());
+                            if (ImGui::TreeNode("Skipped Files")) {
+                                for (const std::string& skipped_file : sequence->GetSkippedFiles()) {
+                                    ImGui::BulletText("%s", skipped_file.c_str());
+                                }
+                                ImGui::TreePop();
+                            }
+                        }
+                        if (sequence->IsOpen()) {
+                            ImGui::Checkbox("Play", sequence->PlayingHelper());
+                            ImGui::SliderFloat("Playback FPS", sequence->FrameRateHelper(), 1.0f, 60.0f);
+                            int prefetch_count = sequence->GetPrefetchCount();
+                            if (ImGui::SliderInt("Prefetch", &prefetch_count, 1, 16)) {
+                                sequence->SetPrefetchCount(prefetch_count);
+                            }
+                            int buffer_budget = static_cast<int>(sequence->GetBufferBudget() >> 20);
+                            if (ImGui::SliderInt("Buffer Budget (MB)", &buffer_budget, 64, 8192)) {
+                                sequence->SetBufferBudget(static_cast<size_t>(buffer_budget) << 20);
+                            }
+                            int timestep = sequence->GetCurrentFrame();
+                            if (ImGui::SliderInt("Timestep", &timestep, 0, sequence->GetFrameCount() - 1)) {
+                                sequence->Seek(timestep);
+                            }
+                            const VolumeSequence::Stats& sequence_stats = sequence->GetStats();
+                            const size_t buffered_count = sequence->GetBufferedCount();
+                            ImGui::BulletText("Buffered: %zu / %d (%.1f MB)", buffered_count, sequence->GetPrefetchWindow() + 1,
+                                buffered_count * sequence->GetFrameBytes() / 1048576.0);
+                            ImGui::BulletText("Displayed: %zu, Dropped: %zu", sequence_stats.displayed_frames, sequence_stats.dropped_frames);
+                            ImGui::BulletText("Prefetch Hits: %zu, Misses: %zu", sequence_stats.prefetch_hits, sequence_stats.prefetch_misses);
+                        }
+                    }
+                    if (ImGui::CollapsingHeader("CPU Volume Layout")) {
+                        // CPU 端的 voxel 排列方式：CPU Renderer 的 VolumeData，以及切片、illumination、iso surface 讀的 raw volume
+                        if (ImGui::BeginCombo("Voxel Layout", VoxelLayout::GetLayoutName(volume_layout))) {
+                            for (VolumeLayout layout : { VOLUME_LAYOUT_LINEAR, VOLUME_LAYOUT_MORTON, VOLUME_LAYOUT_BRICKED }) {
+                                bool is_selected = (volume_layout == layout);
+                                if (ImGui::Selectable(VoxelLayout::GetLayoutName(layout), is_selected)) {
+                                    volume_layout = layout;
+                                    // 資料可能正被 render server 使用，重新排列的是一份新的
+                                    if (volume_data) {
+                                        auto relaid = std::make_shared<VolumeData>(*volume_data);
+                                        relaid->SetLayout(volume_layout);
+                                        volume_layout = relaid->GetLayout();
+                                        volume_data = relaid;
+                                    }
+                                    // 同樣的資料換個排列，version 不變，從它建出來的東西都不用重建
+                                    if (raw_volume) {
+                                        raw_volume = raw_volume->WithLayout(volume_layout);
+                                    }
+                                    sequence->SetLayout(volume_layout);
+                                }
+                                if (is_selected) {
+                                    ImGui::SetItemDefaultFocus();
+                                }
+                            }
+                            ImGui::EndCombo();
+                        }
+                        if (ImGui::Button("Layout Benchmark") && EnsureVolumeData()) {
+                            volume_data->BenchmarkLayouts();
+                        }
+                    }
+                    if (ImGui::CollapsingHeader("Slice Views")) {
+                        // 只有在 3O1P 模式下才會畫在三個正交視窗
+                        ImGui::Checkbox("Show Slices In 3O1P", &show_slice_views);
+                        const char* view_names[3] = { "Orthogonal X", "Orthogonal Y", "Orthogonal Z" };
+                        for (int i = 0; i < 3; i++) {
+                            SliceRequest& request = slice_views[i].request;
+                            ImGui::PushID(i);
+                            ImGui::Text("%s", view_names[i]);
+                            ImGui::SliderFloat("Position", &request.position, 0.0f, 1.0f);
+                            bool is_oblique = request.axis == SLICE_AXIS_OBLIQUE;
+                            if (ImGui::Checkbox("Oblique", &is_oblique)) {
+                                request.axis = is_oblique ? SLICE_AXIS_OBLIQUE : static_cast<SliceAxis>(SLICE_AXIS_X + i);
+                            }
+                            if (is_oblique) {
+                                ImGui::SliderFloat3("Normal", &request.normal[0], -1.0f, 1.0f);
+                                ImGui::SliderInt("Size", &request.width, 64, 2048);
+                                request.height = request.width;
+                            }
+                            ImGui::PopID();
+                        }
+                        const SliceRenderer::Stats& slice_stats = slice_renderer->GetStats();
+                        if (const std::shared_ptr<const RawVolume> volume = GetActiveRawVolume()) {
+                            ImGui::BulletText("Samples: %d-bit, %.1f MB", volume->GetBytesPerSample() * 8, volume->GetMemorySize() / 1048576.0);
+                        }
+                        ImGui::BulletText("Last Slice: %.2f ms", slice_renderer->GetLastRenderTime());
+                        ImGui::BulletText("Cache Hits: %zu, Misses: %zu, %.1f MB", slice_stats.hits, slice_stats.misses, slice_stats.cached_bytes / 1048576.0);
+                    }
                     if (ImGui::CollapsingHeader("Gradient Histogram")) {
                         ImGui::PlotHistogram("Gradient Histogram", gradient_histogram.data(), gradient_histogram.size(), 0, NULL, 0.0f, gradient_histogram_max, ImVec2(0, 300));
                     }
@@ -448,7 +674,12 @@ public:
                         ImGui::PlotHistogram("Histogram", iso_value_histogram.data(), iso_value_histogram.size(), 0, NULL, 0.0f, iso_value_histogram_max, ImVec2(0, 300));
                     }
                     if (ImGui::Button("Equalization")) {
+                        const std::vector<float> histogram = iso_value_histogram;
+                        // engine 要改它的 volume 材質，先把釋放掉的內容放回去
+                        RestoreEngineVolumeTextureNow();
                         engine->IsoValueHistogramEqualization();
+                        volume_data = nullptr;
+                        EqualizeRawVolume(histogram);
                         iso_value_histogram = engine->GetIsoValueHistogram();
 
                         engine->GenerateGradientHeatMap();
@@ -485,31 +716,102 @@ public:
                     if (engine->GetCurrentRenderMode() == Nexus::RENDER_MODE_ISO_SURFACE) {
                         ImGui::SliderFloat("Iso Value", &iso_value, 0, 255);
                         if (ImGui::Button("Generate")) {
-                            if (engine->GetIsInitialize()) {
-                                engine->SetIsoValue(iso_value);
-                                engine->ConvertToPolygon();
-                                engine->Debug();
-                                // iso_value_shader = iso_value;
-                            } else {
-                                Nexus::Logger::Message(Nexus::LOG_ERROR, "YOU MUST LOAD THE VOLUME DATA FIRST and COMPUTE THESE ISO SURFACE VERTICES.");
-                            }
+                            Generate();
+                            // iso_value_shader = iso_value;
+                        }
+                        ImGui::SameLine();
+                        if (ImGui::Button("Render On CPU")) {
+                            RenderIsoSurfaceOnCpu();
                         }
                         ImGui::Spacing();
                         ImGui::Separator();
                         ImGui::Checkbox("Normal Visualize", &Settings.NormalVisualize);
                         ImGui::SameLine();
                         ImGui::Checkbox("Wire Frame Mode", engine->WireFrameModeHelper());
+                        if (iso_extractor->GetStats().triangle_count > 0) {
+                            // 每次 Generate 都重複使用同一塊 arena，除非表面變大才會再向 heap 要記憶體
+                            const IsoSurfaceExtractor::Stats& iso_stats = iso_extractor->GetStats();
+                            const ChunkArena::Stats& arena_stats = iso_extractor->GetArenaStats();
+                            ImGui::BulletText("Triangles: %zu (count %.1f ms, fill %.1f ms)", iso_stats.triangle_count, iso_stats.count_time, iso_stats.fill_time);
+                            if (uploader->IsBufferPending(iso_vbo)) {
+                                ImGui::BulletText("Uploading: %d / %d triangles", GetIsoDrawCount() / 3, iso_draw_count / 3);
+                            }
+                            ImGui::BulletText("Arena: %zu heap allocations, %zu releases, %.1f MB in use, peak %.1f MB, reserved %.1f MB",
+                                arena_stats.heap_allocations, arena_stats.heap_releases, arena_stats.bytes_in_use / 1048576.0,
+                                arena_stats.peak_bytes / 1048576.0, arena_stats.reserved_bytes / 1048576.0);
+                        }
                     } else if (engine->GetCurrentRenderMode() == Nexus::RENDER_MODE_RAY_CASTING) {
                         ImGui::SliderFloat("Sample Rate", &sample_rate, 0.01, 1);
+                        ImGui::Checkbox("Adaptive Step", &use_adaptive_step);
+                        if (use_adaptive_step) {
+                            // 梯度大小是相對於 max_gradient 的比例
+                            ImGui::SliderFloat("Boundary Gradient", &boundary_gradient, 0.05f, 1.0f);
+                        }
+                        if (cpu_ray_caster->GetLastSampleCount() > 0) {
+                            // GPU 的取樣數沒有量，這是上一次 "Render On CPU" 用同樣演算法得到的估計值，不是 GPU 畫面的實際數字
+                            ImGui::Text("Samples (CPU estimate, GPU not measured): %zu (%.1f per pixel)", cpu_ray_caster->GetLastSampleCount(),
+                                static_cast<double>(cpu_ray_caster->GetLastSampleCount()) / (static_cast<double>(cpu_frame_width) * cpu_frame_height));
+                        }
                         ImGui::Checkbox("Normal Color", &use_normal_color);
                         ImGui::Checkbox("Lighting", &use_lighting);
-                        if (ImGui::Button("Generate")) {
-                            if (engine->GetIsInitialize()) {
-                                engine->ConvertToPolygon();
-                                engine->Debug();
-                            } else {
-                                Nexus::Logger::Message(Nexus::LOG_ERROR, "YOU MUST LOAD THE VOLUME DATA FIRST and COMPUTE THESE ISO SURFACE VERTICES.");
+                        ImGui::Checkbox("Illumination Volume", &use_illumination);
+                        if (ImGui::BeginCombo("Gradient Storage", GetGradientEncodingName(gradient_encoding))) {
+                            for (GradientEncoding encoding : { GRADIENT_ENCODING_FLOAT, GRADIENT_ENCODING_OCT8, GRADIENT_ENCODING_OCT16 }) {
+                                bool is_selected = (gradient_encoding == encoding);
+                                if (ImGui::Selectable(GetGradientEncodingName(encoding), is_selected)) {
+                                    gradient_encoding = encoding;
+                                }
+                                if (is_selected) {
+                                    ImGui::SetItemDefaultFocus();
+                                }
                             }
+                            ImGui::EndCombo();
+                        }
+                        if (gradient_encoding != GRADIENT_ENCODING_FLOAT) {
+                            // 打包的材質上傳好之後，引擎的 float 材質 (16 B/voxel) 就釋放掉
+                            const GradientAngularError& error = packed_gradients->GetAngularError();
+                            ImGui::Text("%zu B/voxel on the GPU%s, max error %.3f deg%s", packed_gradients->GetBytesPerVoxel(),
+                                engine_texture_state == ENGINE_TEXTURE_RELEASED ? " (float volume released)" : "", error.max_degrees,
+                                packed_gradients->IsPacking() ? " (packing)" : (error.is_passed ? "" : " (FAILED)"));
+                        }
+                        if (use_illumination) {
+                            ImGui::SliderFloat("Shadow Density", illumination->DensityHelper(), 0.1f, 4.0f);
+                            const glm::ivec3& illumination_resolution = illumination->GetResolution();
+                            ImGui::Text("%d x %d x %d, %.1f ms%s", illumination_resolution.x, illumination_resolution.y, illumination_resolution.z,
+                                illumination->GetLastComputeTime(), illumination->IsComputing() ? " (updating)" : (illumination->IsStale() ? " (stale, light moving)" : ""));
+                        }
+                        ImGui::Checkbox("Auto Render Scale", &auto_render_scale);
+                        if (auto_render_scale) {
+                            ImGui::SliderFloat("Target Frame Time (ms)", &target_frame_time, 8.0f, 100.0f);
+                            ImGui::Text("Render Scale: %.2f", render_scale);
+                        } else {
+                            ImGui::SliderFloat("Render Scale", &render_scale, 0.25f, 1.0f);
+                        }
+                        ImGui::Combo("Upsampling", &upsampling_mode, "Bilinear\0Edge-Aware\0");
+                        if (ImGui::BeginCombo("CPU Kernel", CpuRayCaster::GetKernelName(cpu_ray_caster->GetKernel()))) {
+                            for (CpuRayCastKernel kernel : { CPU_KERNEL_SCALAR, CPU_KERNEL_PACKET, CPU_KERNEL_AVX2 }) {
+                                if (!CpuRayCaster::IsKernelSupported(kernel)) {
+                                    continue;
+                                }
+                                bool is_selected = (cpu_ray_caster->GetKernel() == kernel);
+                                if (ImGui::Selectable(CpuRayCaster::GetKernelName(kernel), is_selected)) {
+                                    cpu_ray_caster->SetKernel(kernel);
+                                }
+                                if (is_selected) {
+                                    ImGui::SetItemDefaultFocus();
+                                }
+                            }
+                            ImGui::EndCombo();
+                        }
+                        if (ImGui::Button("Render On CPU")) {
+                            RayCastOnCpu(false);
+                        }
+                        ImGui::SameLine();
+                        if (ImGui::Button("Benchmark")) {
+                            RayCastOnCpu(true);
+                        }
+                        if (ImGui::Button("Generate")) {
+                            Generate();
                         }
                     }
 
@@ -529,6 +831,16 @@ public:
         ImGui::Separator();
         ImGui::End();
 
+		if (show_cpu_frame) {
+			// 顯示 CPU 算出來的畫面（像素是由下往上存的，所以 uv 要上下顛倒）
+			ImGui::Begin("CPU Renderer", &show_cpu_frame, ImGuiWindowFlags_AlwaysAutoResize);
+			ImGui::Text("%d x %d, %.2f ms, %u threads", cpu_frame_width, cpu_frame_height, cpu_frame_time, scheduler->GetThreadCount());
+			const StreamingUploader::Stats& upload_stats = uploader->GetStats();
+			ImGui::Text("Upload (%s): %.2f MB pending, %zu stalls", uploader->IsPersistent() ? "persistent" : "mapped", upload_stats.pending_bytes / 1048576.0, upload_stats.stalls);
+			ImGui::Image((void*)(intptr_t)cpu_frame_texture, ImVec2(static_cast<float>(cpu_frame_width), static_cast<float>(cpu_frame_height)), ImVec2(0, 1), ImVec2(1, 0));
+			ImGui::End();
+		}
+
 		ImGui::Begin("General Setting");
 		if (ImGui::BeginTabBar("GeneralTabBar", tab_bar_flags)) {
 
@@ -635,6 +947,37 @@ public:
 				ImGui::EndTabItem();
 			}
 
+			if (ImGui::BeginTabItem("Render Server")) {
+				// 把 CPU 畫出來的畫面透過 127.0.0.1 傳給 RenderClient 之類的客戶端
+				if (render_server->IsRunning()) {
+					ImGui::Text("Listening on 127.0.0.1:%d", render_server_port);
+					if (ImGui::Button("Stop")) {
+						render_server->Stop();
+					}
+					const RenderServer::Stats server_stats = render_server->GetStats();
+					ImGui::BulletText("Client: %s", server_stats.is_client_connected ? "connected" : "none");
+					ImGui::BulletText("Requests: %zu, Frames: %zu, Coalesced: %zu", server_stats.requests, server_stats.frames_sent, server_stats.frames_dropped);
+					ImGui::BulletText("Render: %.2f ms, Encode: %.2f ms", server_stats.last_render_time, server_stats.last_encode_time);
+					ImGui::BulletText("Sent: %.2f MB, Compression: %.1f : 1", server_stats.sent_bytes / 1048576.0,
+						server_stats.sent_bytes > 0 ? static_cast<double>(server_stats.raw_bytes) / server_stats.sent_bytes : 0.0);
+				} else {
+					ImGui::InputInt("Port", &render_server_port);
+					render_server_port = std::clamp(render_server_port, 1024, 65535);
+					if (ImGui::Button("Start")) {
+						if (engine->GetIsInitialize() && engine->GetIsReadyToDraw() && GetActiveRawVolume()) {
+							// The volume follows from UpdateRenderServerVolume(), the server waits for it before the first frame
+							render_server->SetDefaults(tf_widget.get_colormapf(), Settings.BackgroundColor, point_light->GetDiffuse());
+							render_server_request = ServerVolumeRequest();
+							render_server_is_waiting = false;
+							render_server->Start(static_cast<uint16_t>(render_server_port));
+						} else {
+							Nexus::Logger::Message(Nexus::LOG_ERROR, "YOU MUST LOAD THE VOLUME DATA FIRST before starting the render server.");
+						}
+					}
+				}
+				ImGui::EndTabItem();
+			}
+
 			ImGui::EndTabBar();
 		}
 		ImGui::Spacing();
@@ -642,6 +985,82 @@ public:
 		ImGui::End();
 	}
 
+	// 用 count pass 先算出三角形數量，整個表面一次從 arena 配置
+	// The Generate button of both modes. The iso surface always comes from IsoSurfaceExtractor, the engine only builds
+	// the geometry engine->Draw() needs in ray casting mode. Its counters are logged right after engine->Debug().
+	void Generate() {
+		if (!engine->GetIsInitialize()) {
+			Nexus::Logger::Message(Nexus::LOG_ERROR, "YOU MUST LOAD THE VOLUME DATA FIRST and COMPUTE THESE ISO SURFACE VERTICES.");
+			return;
+		}
+		engine->SetIsoValue(iso_value);
+		if (engine->GetCurrentRenderMode() == Nexus::RENDER_MODE_ISO_SURFACE) {
+			GenerateIsoSurface();
+		} else {
+			engine->ConvertToPolygon();
+		}
+		engine->Debug();
+		iso_extractor->Debug();
+	}
+
+	void GenerateIsoSurface() {
+		const std::shared_ptr<const RawVolume> volume = GetActiveRawVolume();
+		if (!volume) {
+			Nexus::Logger::Message(Nexus::LOG_ERROR, "The raw volume is not loaded, please load the volume data first.");
+			return;
+		}
+		// The previous vertices are overwritten in the arena, so their upload must not continue
+		uploader->CancelBuffer(iso_vbo);
+		iso_extractor->Extract(*volume, iso_value);
+
+		const size_t bytes = iso_extractor->GetVertexCount() * sizeof(IsoVertex);
+		if (iso_vao == 0) {
+			glGenVertexArrays(1, &iso_vao);
+			glGenBuffers(1, &iso_vbo);
+			glBindVertexArray(iso_vao);
+			glBindBuffer(GL_ARRAY_BUFFER, iso_vbo);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(IsoVertex), (void*)offsetof(IsoVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(IsoVertex), (void*)offsetof(IsoVertex, normal));
+			glBindVertexArray(0);
+		}
+		// Like the arena, the buffer only grows. The vertices are streamed in by the uploader and drawn as they arrive.
+		if (bytes > iso_vbo_capacity) {
+			glBindBuffer(GL_ARRAY_BUFFER, iso_vbo);
+			glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			iso_vbo_capacity = bytes;
+		}
+		// One range per slab block of the arena, in buffer order so the front of the buffer fills up
+		for (const IsoSurfaceExtractor::Block& block : iso_extractor->GetBlocks()) {
+			uploader->QueueBuffer(iso_vbo, block.first_vertex * sizeof(IsoVertex), block.vertex_count * sizeof(IsoVertex),
+				kIsoUploadBlockTriangles * 3 * sizeof(IsoVertex), block.vertices);
+		}
+		iso_draw_count = static_cast<GLsizei>(iso_extractor->GetVertexCount());
+	}
+
+	// Only the triangles already on the GPU while the surface is still streaming
+	GLsizei GetIsoDrawCount() const {
+		if (uploader->IsBufferPending(iso_vbo)) {
+			return static_cast<GLsizei>(uploader->GetUploadedBytes(iso_vbo) / sizeof(IsoVertex));
+		}
+		return iso_draw_count;
+	}
+
+	void DrawIsoSurface(Nexus::Shader* shader, const glm::mat4& model_matrix) const {
+		shader->Use();
+		shader->SetMat4("model", model_matrix);
+		shader->SetMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model_matrix))));
+		if (*engine->WireFrameModeHelper()) {
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		}
+		glBindVertexArray(iso_vao);
+		glDrawArrays(GL_TRIANGLES, 0, GetIsoDrawCount());
+		glBindVertexArray(0);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	}
+
 	void DrawOriginAnd3Axes(Nexus::Shader* shader) const {
         shader->Use();
 
@@ -736,6 +1155,9 @@ public:
 
 	void OnWindowResize() override {
 		ProjectionSettings.Aspect = (float)Settings.Width / (float)Settings.Height;
+		if (Settings.Width > 0 && Settings.Height > 0) {
+			ResizeFramebuffer(Settings.Width, Settings.Height);
+		}
 	}
 
 	void OnProcessInput(int key) override {
@@ -849,6 +1271,293 @@ public:
 		}
 	}
 
+	CpuRenderView GetCpuRenderView() {
+		SetViewMatrix(Nexus::DISPLAY_MODE_DEFAULT);
+		SetProjectionMatrix(Nexus::DISPLAY_MODE_DEFAULT);
+
+		CpuRenderView cpu_view;
+		cpu_view.width = Settings.Width;
+		cpu_view.height = Settings.Height;
+		cpu_view.view = view;
+		cpu_view.projection = projection;
+		cpu_view.view_position = Settings.EnableGhostMode ? first_camera->GetPosition() : third_camera->GetPosition();
+		cpu_view.light_position = point_light->GetPosition();
+		cpu_view.light_color = point_light->GetDiffuse();
+		cpu_view.background_color = Settings.BackgroundColor;
+		cpu_view.volume_size = engine->GetResolution() * engine->GetRatio();
+		return cpu_view;
+	}
+
+	GLuint GetActiveVolumeTexture() const {
+		if (sequence->IsOpen() && sequence->GetTexture() != 0) {
+			return sequence->GetTexture();
+		}
+		return engine->GetVolumeTexture();
+	}
+
+	bool EnsureVolumeData() {
+		// 直接從 raw 檔的樣本建，不讀回 GPU 的材質；播放時間序列時跟著目前的 timestep（每一格的 version 都不同）
+		const std::shared_ptr<const RawVolume> raw = GetActiveRawVolume();
+		const size_t raw_version = raw ? raw->GetVersion() : 0;
+		if (raw_version != volume_data_raw_version) {
+			volume_data = nullptr;
+			volume_data_raw_version = raw_version;
+		}
+		if (volume_data) {
+			return true;
+		}
+		auto loaded = std::make_shared<VolumeData>();
+		if (!raw || !loaded->LoadFromRawVolume(*raw, GetActiveMaxGradient(), volume_layout)) {
+			Nexus::Logger::Message(Nexus::LOG_ERROR, "The volume data is not ready, please load the volume data first.");
+			return false;
+		}
+		volume_data = loaded;
+		return true;
+	}
+
+	// 打包的梯度在用的時候沒有人讀 engine 的 float volume 材質 (16 B/voxel)，把它縮成 1 個 texel 釋放記憶體。
+	// 切回 float 或開啟時間序列時，在背景從 raw 檔重建同樣的 texel 再串流上傳回去。
+	void UpdateEngineVolumeTexture() {
+		const GLuint texture = engine->GetVolumeTexture();
+		if (engine_texture_restore.valid() && engine_texture_restore.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			const std::shared_ptr<const std::vector<glm::vec4>> texels = engine_texture_restore.get();
+			glBindTexture(GL_TEXTURE_3D, texture);
+			glTexImage3D(GL_TEXTURE_3D, 0, engine_texture_format, engine_texture_size.x, engine_texture_size.y, engine_texture_size.z, 0, GL_RGBA, GL_FLOAT, nullptr);
+			glBindTexture(GL_TEXTURE_3D, 0);
+			uploader->QueueTexture3D(texture, engine_texture_size.x, engine_texture_size.y, engine_texture_size.z, GL_RGBA, GL_FLOAT, sizeof(glm::vec4), texels->data(), texels);
+		}
+		if (engine_texture_state == ENGINE_TEXTURE_RESTORING && !engine_texture_restore.valid() && !uploader->IsPending(texture)) {
+			engine_texture_state = ENGINE_TEXTURE_RESIDENT;
+		}
+
+		const bool is_packed_in_use = gradient_encoding != GRADIENT_ENCODING_FLOAT && !sequence->IsOpen();
+		if (engine_texture_state == ENGINE_TEXTURE_RESIDENT && is_packed_in_use && packed_gradients->GetGradientTexture() != 0 && raw_volume && texture != 0) {
+			GLint width = 0, height = 0, depth = 0;
+			glBindTexture(GL_TEXTURE_3D, texture);
+			glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_INTERNAL_FORMAT, &engine_texture_format);
+			glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_WIDTH, &width);
+			glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_HEIGHT, &height);
+			glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_DEPTH, &depth);
+			engine_texture_size = glm::ivec3(width, height, depth);
+			glTexImage3D(GL_TEXTURE_3D, 0, engine_texture_format, 1, 1, 1, 0, GL_RGBA, GL_FLOAT, nullptr);
+			glBindTexture(GL_TEXTURE_3D, 0);
+			engine_texture_state = ENGINE_TEXTURE_RELEASED;
+		} else if (engine_texture_state == ENGINE_TEXTURE_RELEASED && !is_packed_in_use) {
+			engine_texture_state = ENGINE_TEXTURE_RESTORING;
+			engine_texture_restore = std::async(std::launch::async, [raw = raw_volume, gradient_limit = volume_max_gradient]() {
+				return std::make_shared<const std::vector<glm::vec4>>(raw->BuildTexels(gradient_limit));
+			});
+		}
+	}
+
+	// Before the engine touches its volume texture again
+	void RestoreEngineVolumeTextureNow() {
+		if (engine_texture_state == ENGINE_TEXTURE_RESIDENT) {
+			return;
+		}
+		const GLuint texture = engine->GetVolumeTexture();
+		if (engine_texture_restore.valid()) {
+			engine_texture_restore.wait();
+			engine_texture_restore = {};
+		}
+		uploader->Cancel(texture);
+		const std::vector<glm::vec4> texels = raw_volume->BuildTexels(volume_max_gradient);
+		glBindTexture(GL_TEXTURE_3D, texture);
+		glTexImage3D(GL_TEXTURE_3D, 0, engine_texture_format, engine_texture_size.x, engine_texture_size.y, engine_texture_size.z, 0, GL_RGBA, GL_FLOAT, texels.data());
+		glBindTexture(GL_TEXTURE_3D, 0);
+		engine_texture_state = ENGINE_TEXTURE_RESIDENT;
+	}
+
+	// The engine is about to create its volume texture anew, what was released or restored is of no use any more
+	void ResetEngineVolumeTexture() {
+		if (engine_texture_restore.valid()) {
+			engine_texture_restore.wait();
+			engine_texture_restore = {};
+		}
+		uploader->Cancel(engine->GetVolumeTexture());
+		engine_texture_state = ENGINE_TEXTURE_RESIDENT;
+	}
+
+	void RenderIsoSurfaceOnCpu() {
+		if (!EnsureVolumeData()) {
+			return;
+		}
+
+		const CpuRenderView cpu_view = GetCpuRenderView();
+		cpu_iso_renderer->SetUseLighting(use_iso_lighting);
+		cpu_iso_renderer->Render(*volume_data, cpu_view, iso_value, AllocateCpuFrame(cpu_view));
+		UploadCpuFrame(cpu_view, cpu_iso_renderer->GetLastRenderTime());
+
+		Nexus::Logger::Message(Nexus::LOG_INFO, "CPU iso surface rendering: " + std::to_string(cpu_frame_time) + " ms.");
+	}
+
+	void RayCastOnCpu(bool is_benchmark) {
+		if (!EnsureVolumeData()) {
+			return;
+		}
+
+		const CpuRenderView cpu_view = GetCpuRenderView();
+		cpu_ray_caster->SetSampleRate(sample_rate);
+		cpu_ray_caster->SetUseLighting(use_lighting);
+		cpu_ray_caster->SetUseNormalColor(use_normal_color);
+		cpu_ray_caster->SetUseAdaptiveStep(use_adaptive_step);
+		cpu_ray_caster->SetBoundaryGradient(boundary_gradient);
+		unsigned char* pixels = AllocateCpuFrame(cpu_view);
+		if (is_benchmark) {
+			cpu_ray_caster->Benchmark(*volume_data, cpu_view, tf_widget.get_colormapf(), pixels);
+		}
+		cpu_ray_caster->Render(*volume_data, cpu_view, tf_widget.get_colormapf(), pixels);
+		UploadCpuFrame(cpu_view, cpu_ray_caster->GetLastRenderTime());
+	}
+
+	unsigned char* AllocateCpuFrame(const CpuRenderView& cpu_view) {
+		// The uploader may still be reading the previous frame
+		uploader->Cancel(cpu_frame_texture);
+		cpu_frame_pixels.resize(static_cast<size_t>(cpu_view.width) * cpu_view.height * 4);
+		return cpu_frame_pixels.data();
+	}
+
+	void UploadCpuFrame(const CpuRenderView& cpu_view, float time) {
+		if (cpu_frame_texture == 0) {
+			glGenTextures(1, &cpu_frame_texture);
+			glBindTexture(GL_TEXTURE_2D, cpu_frame_texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+		if (cpu_frame_width != cpu_view.width || cpu_frame_height != cpu_view.height) {
+			// Only (re)allocate the storage here, the pixels are streamed in by the uploader
+			glBindTexture(GL_TEXTURE_2D, cpu_frame_texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cpu_view.width, cpu_view.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		cpu_frame_width = cpu_view.width;
+		cpu_frame_height = cpu_view.height;
+		cpu_frame_time = time;
+
+		uploader->QueueTexture2D(cpu_frame_texture, cpu_frame_width, cpu_frame_height, GL_RGBA, GL_UNSIGNED_BYTE, 4, cpu_frame_pixels.data());
+		show_cpu_frame = true;
+	}
+
+	void DrawSliceView(Nexus::DisplayMode monitor_type) {
+		const int index = monitor_type == Nexus::DISPLAY_MODE_ORTHOGONAL_X ? 0 : (monitor_type == Nexus::DISPLAY_MODE_ORTHOGONAL_Y ? 1 : 2);
+		SliceView& slice_view = slice_views[index];
+		SetViewport(monitor_type);
+		const std::shared_ptr<const RawVolume> volume = GetActiveRawVolume();
+		if (!volume || !UpdateSliceView(slice_view, *volume)) {
+			return;
+		}
+
+		// Fit the slice into the viewport without stretching it
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		const glm::vec2 world_size = SliceRenderer::GetWorldSize(slice_view.request, glm::vec3(volume->GetResolution()) * volume->GetRatio());
+		const float scale = std::min(viewport[2] / world_size.x, viewport[3] / world_size.y);
+		const int width = std::max(1, static_cast<int>(world_size.x * scale));
+		const int height = std::max(1, static_cast<int>(world_size.y * scale));
+		const glm::ivec2 offset(viewport[0] + (viewport[2] - width) / 2, viewport[1] + (viewport[3] - height) / 2);
+		glViewport(offset.x, offset.y, width, height);
+
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_CULL_FACE);
+		screenShader->Use();
+		screenShader->SetInt("screen_texture", 0);
+		screenShader->SetInt("upsampling_mode", 0);
+		screenShader->SetVec2("viewport_offset", glm::vec2(offset));
+		screenShader->SetVec2("viewport_size", glm::vec2(width, height));
+		screenShader->SetVec2("source_size", glm::vec2(slice_view.width, slice_view.height));
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, slice_view.texture);
+		quad->Draw(screenShader.get());
+		glEnable(GL_DEPTH_TEST);
+
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	// 切片直接讀 raw 檔的資料，不需要從 GPU 讀回整個 volume texture
+	void LoadRawVolume(const std::string& inf_path, const std::string& raw_path) {
+		raw_volume = nullptr;
+		VolumeInfo info;
+		if (!VolumeInfo::Load(inf_path, info)) {
+			Nexus::Logger::Message(Nexus::LOG_WARNING, "Slices: cannot read " + inf_path);
+			return;
+		}
+		raw_volume = RawVolume::Load(raw_path, info, volume_layout);
+	}
+
+	// engine 做完 histogram equalization 後，raw 檔的資料也要做同樣的對應，切片、illumination、packed gradients
+	// 和 iso surface 才會跟畫面一致。histogram 是等化之前 engine 的 iso value histogram。
+	void EqualizeRawVolume(const std::vector<float>& histogram) {
+		if (!raw_volume || histogram.empty()) {
+			return;
+		}
+		std::vector<float> cdf(histogram.size());
+		float total = 0.0f;
+		for (size_t i = 0; i < histogram.size(); i++) {
+			total += histogram[i];
+			cdf[i] = total;
+		}
+		if (total <= 0.0f) {
+			return;
+		}
+		for (float& value : cdf) {
+			value /= total;
+		}
+		raw_volume = raw_volume->Remap(cdf);
+	}
+
+	// Gradient threshold of the texture GetActiveVolumeTexture() returns
+	float GetActiveMaxGradient() const {
+		if (sequence->IsOpen() && sequence->GetRawVolume()) {
+			return sequence->GetMaxGradient();
+		}
+		return volume_max_gradient;
+	}
+
+	std::shared_ptr<const RawVolume> GetActiveRawVolume() const {
+		if (sequence->IsOpen() && sequence->GetRawVolume()) {
+			return sequence->GetRawVolume();
+		}
+		return raw_volume;
+	}
+
+	// Regenerate the slice image only when the plane, the transfer function or the volume changed.
+	bool UpdateSliceView(SliceView& slice_view, const RawVolume& volume) {
+		const std::vector<float>& colormap = tf_widget.get_colormapf();
+		if (slice_view.texture != 0 && slice_view.request == slice_view.shown_request && colormap == slice_view.shown_colormap
+			&& volume.GetVersion() == slice_view.shown_version) {
+			return true;
+		}
+
+		std::shared_ptr<SliceImage> image = slice_renderer->Render(volume, colormap, slice_view.request, Settings.BackgroundColor);
+		if (!image) {
+			return false;
+		}
+		slice_view.shown_request = slice_view.request;
+		slice_view.shown_colormap = colormap;
+		slice_view.shown_version = volume.GetVersion();
+
+		if (slice_view.texture == 0) {
+			glGenTextures(1, &slice_view.texture);
+			glBindTexture(GL_TEXTURE_2D, slice_view.texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+		uploader->Cancel(slice_view.texture);
+		if (slice_view.width != image->width || slice_view.height != image->height) {
+			glBindTexture(GL_TEXTURE_2D, slice_view.texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			slice_view.width = image->width;
+			slice_view.height = image->height;
+		}
+		uploader->QueueTexture2D(slice_view.texture, image->width, image->height, GL_RGBA, GL_UNSIGNED_BYTE, 4, image->pixels.data(), image);
+		return true;
+	}
+
 	GLuint GetTFTexture(TransferFunctionWidget& tf_widget) {
 		const std::vector<float>& colormap = tf_widget.get_colormapf();
 		const size_t texel_count = colormap.size() / 4;
@@ -908,7 +1617,11 @@ private:
 	std::vector<std::string> gradient_heatmap_labelx_string;
 	std::vector<std::string> gradient_heatmap_labely_string;
 	float iso_value = 80.0;
+	bool use_iso_lighting = false;
 	float max_gradient = 300.0f;
+	float volume_max_gradient = 300.0f;	// max_gradient when the engine's volume was loaded
+	bool use_adaptive_step = false;
+	float boundary_gradient = 0.3f;
 	float iso_value_histogram_max;
 	float gradient_histogram_max;
 	float gradient_heatmap_max;
@@ -923,6 +1636,88 @@ private:
 
 	GLuint framebuffer, rbo;
 	std::unique_ptr<Nexus::Texture2D> texture_color_buffer = nullptr;
+	int framebuffer_width = 0;
+	int framebuffer_height = 0;
+
+	// Ray casting resolution
+	float render_scale = 1.0f;
+	bool auto_render_scale = false;
+	float target_frame_time = 33.0f;
+	float smoothed_frame_time = 33.0f;
+	int render_scale_hold = 0;
+	static constexpr float kRenderScaleStep = 0.05f;
+	static constexpr int kRenderScaleHoldFrames = 30;
+	int upsampling_mode = 1;
+
+	// CPU rendering
+	std::unique_ptr<TaskScheduler> scheduler = nullptr;
+	std::unique_ptr<TaskScheduler> background_scheduler = nullptr;
+	std::unique_ptr<CpuIsoRenderer> cpu_iso_renderer = nullptr;
+	std::unique_ptr<CpuRayCaster> cpu_ray_caster = nullptr;
+	std::unique_ptr<IsoSurfaceExtractor> iso_extractor = nullptr;
+	GLuint iso_vao = 0;
+	GLuint iso_vbo = 0;
+	size_t iso_vbo_capacity = 0;
+	GLsizei iso_draw_count = 0;
+	static constexpr size_t kIsoUploadBlockTriangles = 4096;
+	// Never changed once loaded (the render server reads it on its own thread), replaced instead. nullptr until read back.
+	std::shared_ptr<const VolumeData> volume_data = nullptr;
+	VolumeLayout volume_layout = VOLUME_LAYOUT_BRICKED;
+	size_t volume_data_raw_version = 0;
+	std::vector<unsigned char> cpu_frame_pixels;
+	GLuint cpu_frame_texture = 0;
+	int cpu_frame_width = 0;
+	int cpu_frame_height = 0;
+	float cpu_frame_time = 0.0f;
+	bool show_cpu_frame = false;
+	std::unique_ptr<StreamingUploader> uploader = nullptr;
+	std::unique_ptr<VolumeSequence> sequence = nullptr;
+	std::unique_ptr<IlluminationVolume> illumination = nullptr;
+	bool use_illumination = false;
+	std::unique_ptr<PackedGradientVolume> packed_gradients = nullptr;
+	GradientEncoding gradient_encoding = GRADIENT_ENCODING_FLOAT;
+	// The engine's float volume texture, released while the packed gradients are in use
+	enum EngineTextureState {
+		ENGINE_TEXTURE_RESIDENT,
+		ENGINE_TEXTURE_RELEASED,
+		ENGINE_TEXTURE_RESTORING,	// the texels are being rebuilt or uploaded
+	};
+	EngineTextureState engine_texture_state = ENGINE_TEXTURE_RESIDENT;
+	GLint engine_texture_format = GL_RGBA32F;
+	glm::ivec3 engine_texture_size = glm::ivec3(0);
+	std::future<std::shared_ptr<const std::vector<glm::vec4>>> engine_texture_restore;
+
+	// Slice views of the 3O1P layout
+	struct SliceView {
+		SliceRequest request;
+		SliceRequest shown_request;
+		std::vector<float> shown_colormap;
+		size_t shown_version = 0;
+		GLuint texture = 0;
+		int width = 0;
+		int height = 0;
+	};
+	std::unique_ptr<SliceRenderer> slice_renderer = nullptr;
+	std::shared_ptr<const RawVolume> raw_volume = nullptr;
+	SliceView slice_views[3];
+	bool show_slice_views = true;
+
+	std::unique_ptr<RenderServer> render_server = nullptr;
+	int render_server_port = kRenderServerDefaultPort;
+	// What the server's volume was last built from, see UpdateRenderServerVolume()
+	struct ServerVolumeRequest {
+		size_t raw_version = 0;
+		float max_gradient = 0.0f;
+		VolumeLayout layout = VOLUME_LAYOUT_LINEAR;
+
+		bool operator==(const ServerVolumeRequest& other) const {
+			return raw_version == other.raw_version && max_gradient == other.max_gradient && layout == other.layout;
+		}
+	};
+	ServerVolumeRequest render_server_request;
+	std::future<std::shared_ptr<const VolumeData>> render_server_pending;
+	glm::vec3 render_server_size = glm::vec3(1.0f);
+	bool render_server_is_waiting = false;
 };
 
 int main() {
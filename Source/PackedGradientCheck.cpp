@@ -0,0 +1,81 @@
+// Standalone check of the packed gradients: packs a volume with every octahedral encoding, decodes it again and fails
+// when the angle to the float gradients exceeds GetAngularErrorBound(), per voxel and at interpolated positions.
+// The volume is packed again from a Morton and a bricked RawVolume, which must give exactly the same bytes.
+// Usage: PackedGradientCheck [inf] [raw] [gradient threshold]
+// Returns 0 if every encoding passed.
+
+#include "GradientPacking.h"
+#include "RawVolume.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	// Same cut-off as MeasureAngularError(): shorter gradients are mostly quantization noise of the magnitude
+	const float kMinMagnitude = 0.05f;
+
+	// Largest angle between every voxel's gradient and its decoded one
+	double MeasureRoundTrip(const PackedGradients& packed, const RawVolume& volume, float max_gradient, TaskScheduler& scheduler) {
+		const glm::ivec3& res = packed.resolution;
+		std::vector<double> slice_max(res.z, 0.0);
+		scheduler.ParallelFor(res.z, [&](size_t z) {
+			for (int y = 0; y < res.y; y++) {
+				for (int x = 0; x < res.x; x++) {
+					const glm::vec3 expected = volume.FetchGradient(x, y, static_cast<int>(z), max_gradient);
+					const glm::vec3 decoded = glm::vec3(packed.Decode(volume.LinearIndex(x, y, static_cast<int>(z))));
+					const float magnitude = glm::length(expected);
+					if (magnitude < kMinMagnitude * packed.magnitude_scale || glm::length(decoded) == 0.0f) {
+						continue;
+					}
+					const glm::vec3 a = expected / magnitude, b = glm::normalize(decoded);
+					const double degrees = std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)) * 180.0 / 3.14159265358979323846;
+					slice_max[z] = std::max(slice_max[z], degrees);
+				}
+			}
+		});
+		return res.z > 0 ? *std::max_element(slice_max.begin(), slice_max.end()) : 0.0;
+	}
+}
+
+int main(int argc, char** argv) {
+	const std::string inf_path = argc > 1 ? argv[1] : "Resource/VolumeData/engine.inf";
+	const std::string raw_path = argc > 2 ? argv[2] : "Resource/VolumeData/engine.raw";
+	const float max_gradient = argc > 3 ? static_cast<float>(std::atof(argv[3])) : 300.0f;
+
+	VolumeInfo info;
+	if (!VolumeInfo::Load(inf_path, info)) {
+		std::printf("Cannot read %s.\n", inf_path.c_str());
+		return 1;
+	}
+	const std::shared_ptr<RawVolume> volume = RawVolume::Load(raw_path, info);
+	if (!volume) {
+		std::printf("Cannot read %s.\n", raw_path.c_str());
+		return 1;
+	}
+
+	TaskScheduler scheduler(std::max(1u, std::thread::hardware_concurrency()));
+	bool is_passed = true;
+	for (GradientEncoding encoding : { GRADIENT_ENCODING_OCT8, GRADIENT_ENCODING_OCT16 }) {
+		const std::shared_ptr<PackedGradients> packed = PackGradients(*volume, max_gradient, encoding, scheduler);
+		const double bound = GetAngularErrorBound(encoding);
+		const double round_trip = MeasureRoundTrip(*packed, *volume, max_gradient, scheduler);
+		const GradientAngularError& error = packed->error;
+		bool is_layout_same = true;
+		for (VolumeLayout layout : { VOLUME_LAYOUT_MORTON, VOLUME_LAYOUT_BRICKED }) {
+			const std::shared_ptr<PackedGradients> relaid = PackGradients(*volume->WithLayout(layout), max_gradient, encoding, scheduler);
+			is_layout_same = is_layout_same && relaid->gradients == packed->gradients && relaid->values == packed->values;
+		}
+		const bool is_encoding_passed = round_trip <= bound && error.is_passed && error.samples > 0 && is_layout_same;
+		std::printf("%s: voxels max %.4f deg, interpolated max %.4f deg (mean %.4f over %zu samples), bound %.4f deg, %s across layouts: %s\n",
+			GetGradientEncodingName(encoding), round_trip, error.max_degrees, error.mean_degrees, error.samples, bound,
+			is_layout_same ? "same" : "different", is_encoding_passed ? "PASSED" : "FAILED");
+		is_passed = is_passed && is_encoding_passed;
+	}
+	return is_passed ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#include "PackedGradientVolume.h"
+#include "Logger.h"
+
+#include <chrono>
+#include <string>
+
+PackedGradientVolume::~PackedGradientVolume() {
+	if (pending.valid()) {
+		pending.wait();
+	}
+	glDeleteTextures(1, &gradient_texture);
+	glDeleteTextures(1, &value_texture);
+}
+
+void PackedGradientVolume::Update(const std::shared_ptr<const RawVolume>& volume, float max_gradient, GradientEncoding new_encoding, StreamingUploader& uploader) {
+	if (!volume || volume->GetVoxelCount() == 0 || new_encoding == GRADIENT_ENCODING_FLOAT) {
+		return;
+	}
+	const Request request{ volume->GetVersion(), max_gradient, new_encoding };
+
+	// Finished? Upload it unless something changed in the meantime, then a new pack starts below
+	if (pending.valid() && pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		const std::shared_ptr<const PackedGradients> packed = pending.get();
+		const GradientAngularError& error = packed->error;
+		Nexus::Logger::Message(error.is_passed ? Nexus::LOG_INFO : Nexus::LOG_ERROR, std::string("Packed gradients as ") + GetGradientEncodingName(packed->encoding)
+			+ " in " + std::to_string(packed->pack_time) + " ms, " + std::to_string(4 * packed->component_bytes) + " bytes per voxel, max "
+			+ std::to_string(error.max_degrees) + " deg, mean " + std::to_string(error.mean_degrees) + " deg over " + std::to_string(error.samples)
+			+ " interpolated samples, " + (error.is_passed ? "PASSED" : "FAILED"));
+		if (running == request) {
+			current = running;
+			Upload(packed, uploader);
+		}
+	}
+	if (is_uploading && !uploader.IsPending(gradient_texture) && !uploader.IsPending(value_texture)) {
+		is_uploading = false;
+		has_result = true;
+	}
+
+	if (request == current || pending.valid()) {
+		return;
+	}
+	running = request;
+	pending = std::async(std::launch::async, [this, volume, max_gradient, new_encoding]() -> std::shared_ptr<const PackedGradients> {
+		return PackGradients(*volume, max_gradient, new_encoding, scheduler);
+	});
+}
+
+void PackedGradientVolume::Upload(const std::shared_ptr<const PackedGradients>& packed, StreamingUploader& uploader) {
+	uploader.Cancel(gradient_texture);
+	uploader.Cancel(value_texture);
+
+	encoding = packed->encoding;
+	resolution = packed->resolution;
+	component_bytes = packed->component_bytes;
+	magnitude_scale = packed->magnitude_scale;
+	angular_error = packed->error;
+
+	// The gradient codes are read with texelFetch() and must not be filtered across the fold of the octahedron,
+	// the value is filtered like the float volume
+	const GLenum type = component_bytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+	struct Target {
+		GLuint* texture;
+		GLenum internal_format;
+		GLenum format;
+		GLint filter;
+	};
+	const Target targets[2] = {
+		{ &gradient_texture, static_cast<GLenum>(component_bytes == 2 ? GL_RGB16 : GL_RGB8), GL_RGB, GL_NEAREST },
+		{ &value_texture, static_cast<GLenum>(component_bytes == 2 ? GL_R16 : GL_R8), GL_RED, GL_LINEAR },
+	};
+	for (const Target& target : targets) {
+		if (*target.texture == 0) {
+			glGenTextures(1, target.texture);
+		}
+		glBindTexture(GL_TEXTURE_3D, *target.texture);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, target.filter);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, target.filter);
+		glTexImage3D(GL_TEXTURE_3D, 0, target.internal_format, resolution.x, resolution.y, resolution.z, 0, target.format, type, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	// The packed data goes away with the last upload
+	uploader.QueueTexture3D(gradient_texture, resolution.x, resolution.y, resolution.z, GL_RGB, type, 3 * component_bytes, packed->gradients.data(), packed);
+	uploader.QueueTexture3D(value_texture, resolution.x, resolution.y, resolution.z, GL_RED, type, component_bytes, packed->values.data(), packed);
+	is_uploading = true;
+	has_result = false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "GradientPacking.h"
+#include "StreamingUploader.h"
+#include "TaskScheduler.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <future>
+#include <memory>
+
+// The volume on the GPU with its gradients packed by PackGradients().
+// (normal, magnitude) go to one RGB texture and the value to a single-channel one. The octahedral map folds the lower
+// hemisphere over the diamond edges, so the gradient codes cannot be filtered by the hardware: that texture is
+// GL_NEAREST and ray_casting.frag decodes the 8 corners and interpolates the gradients itself, only for the samples
+// that need a gradient. The value texture is GL_LINEAR, one texture() per sample like the float volume.
+// Packing runs in a background task from the samples of a RawVolume, every result is checked against the float
+// gradients at interpolated positions (see PackedGradientCheck.cpp for the standalone check). The packed data is freed
+// once it is on the GPU.
+class PackedGradientVolume {
+public:
+	// scheduler should not be the one the render thread uses, ParallelFor runs one job at a time.
+	explicit PackedGradientVolume(TaskScheduler& scheduler) : scheduler(scheduler) {}
+	~PackedGradientVolume();
+
+	PackedGradientVolume(const PackedGradientVolume&) = delete;
+	PackedGradientVolume& operator=(const PackedGradientVolume&) = delete;
+
+	// Cheap to call every frame: starts a background repack when the volume, the gradient threshold or the encoding
+	// changed, and streams finished results to the textures. The textures are 0 until the upload is complete.
+	void Update(const std::shared_ptr<const RawVolume>& volume, float max_gradient, GradientEncoding encoding, StreamingUploader& uploader);
+
+	GradientEncoding GetEncoding() const { return encoding; }
+	// Gradient length that a stored magnitude of 1 stands for.
+	float GetMagnitudeScale() const { return magnitude_scale; }
+	// On the GPU, the engine's float volume texture can be released while these are in use
+	size_t GetBytesPerVoxel() const { return 4 * component_bytes; }
+	GLuint GetGradientTexture() const { return has_result ? gradient_texture : 0; }
+	GLuint GetValueTexture() const { return has_result ? value_texture : 0; }
+	bool IsPacking() const { return pending.valid(); }
+	// Of the last packed result
+	const GradientAngularError& GetAngularError() const { return angular_error; }
+
+private:
+	struct Request {
+		size_t volume_version = 0;
+		float max_gradient = 0.0f;
+		GradientEncoding encoding = GRADIENT_ENCODING_FLOAT;
+
+		bool operator==(const Request& other) const {
+			return volume_version == other.volume_version && max_gradient == other.max_gradient && encoding == other.encoding;
+		}
+		bool operator!=(const Request& other) const { return !(*this == other); }
+	};
+
+	void Upload(const std::shared_ptr<const PackedGradients>& packed, StreamingUploader& uploader);
+
+	TaskScheduler& scheduler;
+	Request running;
+	std::future<std::shared_ptr<const PackedGradients>> pending;
+
+	// Of the textures
+	Request current;
+	GradientEncoding encoding = GRADIENT_ENCODING_FLOAT;
+	glm::ivec3 resolution = glm::ivec3(0);
+	size_t component_bytes = 0;
+	float magnitude_scale = 1.0f;
+	GradientAngularError angular_error;
+
+	GLuint gradient_texture = 0;
+	GLuint value_texture = 0;
+	bool is_uploading = false;
+	bool has_result = false;
+};
@@ -0,0 +1,346 @@
+#include "RawVolume.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace {
+	std::string ToLower(std::string text) {
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return text;
+	}
+
+	std::string Trim(const std::string& text) {
+		const size_t begin = text.find_first_not_of(" \t\r\n\xEF\xBB\xBF");
+		const size_t end = text.find_last_not_of(" \t\r\n");
+		return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+	}
+
+	// "149:208:110", "256x256x256" or "1:0.5:1"
+	std::vector<float> SplitNumbers(const std::string& text) {
+		std::string normalized = ToLower(text);
+		std::replace(normalized.begin(), normalized.end(), ':', ' ');
+		std::replace(normalized.begin(), normalized.end(), 'x', ' ');
+		std::istringstream stream(normalized);
+		std::vector<float> numbers;
+		float number;
+		while (stream >> number) {
+			numbers.push_back(number);
+		}
+		return numbers;
+	}
+
+	bool ReadSamples(std::ifstream& file, void* data, size_t bytes) {
+		return static_cast<bool>(file.read(static_cast<char*>(data), static_cast<std::streamsize>(bytes)));
+	}
+
+	template<typename T>
+	void SwapBytes(std::vector<T>& samples) {
+		for (T& sample : samples) {
+			unsigned char* bytes = reinterpret_cast<unsigned char*>(&sample);
+			std::reverse(bytes, bytes + sizeof(T));
+		}
+	}
+
+	size_t NextVersion() {
+		static std::atomic<size_t> next_version{ 1 };
+		return next_version++;
+	}
+}
+
+bool VolumeInfo::Load(const std::string& path, VolumeInfo& info) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	bool has_min = false, has_max = false;
+	std::string line;
+	while (std::getline(file, line)) {
+		const size_t equal = line.find('=');
+		if (equal == std::string::npos) {
+			continue;
+		}
+		const std::string key = ToLower(Trim(line.substr(0, equal)));
+		const std::string value = Trim(line.substr(equal + 1));
+
+		if (key == "resolution") {
+			const std::vector<float> numbers = SplitNumbers(value);
+			if (numbers.size() == 3) {
+				info.resolution = glm::ivec3(static_cast<int>(numbers[0]), static_cast<int>(numbers[1]), static_cast<int>(numbers[2]));
+			}
+		} else if (key == "ratio" || key == "voxelsize") {
+			const std::vector<float> numbers = SplitNumbers(value);
+			if (numbers.size() == 3) {
+				info.ratio = glm::vec3(numbers[0], numbers[1], numbers[2]);
+			}
+		} else if (key == "sample-type" || key == "sampletype") {
+			// "UnsignedChar" -> "unsigned char"
+			std::string type;
+			for (char c : value) {
+				if (std::isupper(static_cast<unsigned char>(c)) && !type.empty()) {
+					type += ' ';
+				}
+				type += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+			}
+			info.sample_type = type;
+		} else if (key == "endian") {
+			info.is_big_endian = ToLower(value) == "big";
+		} else if (key == "valuerange" || key == "value-range" || key == "range") {
+			const std::vector<float> numbers = SplitNumbers(value);
+			if (numbers.size() == 2) {
+				info.value_range = glm::vec2(numbers[0], numbers[1]);
+				has_min = has_max = true;
+			}
+		} else if (key == "min" || key == "minvalue" || key == "min-value") {
+			const std::vector<float> numbers = SplitNumbers(value);
+			if (numbers.size() == 1) {
+				info.value_range.x = numbers[0];
+				has_min = true;
+			}
+		} else if (key == "max" || key == "maxvalue" || key == "max-value") {
+			const std::vector<float> numbers = SplitNumbers(value);
+			if (numbers.size() == 1) {
+				info.value_range.y = numbers[0];
+				has_max = true;
+			}
+		}
+	}
+	info.has_value_range = has_min && has_max && info.value_range.y > info.value_range.x;
+	return info.resolution.x > 0 && info.resolution.y > 0 && info.resolution.z > 0 && info.GetSampleBytes() > 0;
+}
+
+size_t VolumeInfo::GetSampleBytes() const {
+	if (sample_type == "unsigned char" || sample_type == "char") {
+		return 1;
+	}
+	if (sample_type == "unsigned short" || sample_type == "short") {
+		return 2;
+	}
+	if (sample_type == "float") {
+		return 4;
+	}
+	return 0;
+}
+
+std::shared_ptr<RawVolume> RawVolume::Load(const std::string& raw_path, const VolumeInfo& info, VolumeLayout layout) {
+	const size_t sample_bytes = info.GetSampleBytes();
+	if (sample_bytes == 0) {
+		return nullptr;
+	}
+	std::ifstream file(raw_path, std::ios::binary);
+	if (!file.is_open()) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "Cannot open " + raw_path);
+		return nullptr;
+	}
+
+	auto volume = std::make_shared<RawVolume>();
+	volume->resolution = info.resolution;
+	volume->ratio = info.ratio;
+	const size_t voxel_count = volume->GetVoxelCount();
+	if (voxel_count > static_cast<size_t>(INT32_MAX)) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, raw_path + " has too many voxels for the 32-bit voxel offsets.");
+		return nullptr;
+	}
+	volume->voxel_layout.Build(volume->resolution, VOLUME_LAYOUT_LINEAR, INT32_MAX);
+	const bool needs_swap = info.is_big_endian && sample_bytes > 1;
+
+	// Stored samples are unsigned, offset is what was added to make them so
+	float offset = 0.0f;
+	bool is_read = false;
+	if (sample_bytes == 1) {
+		volume->bytes_per_sample = 1;
+		volume->samples8.resize(voxel_count);
+		is_read = ReadSamples(file, volume->samples8.data(), voxel_count);
+		if (is_read && info.IsSigned()) {
+			for (uint8_t& sample : volume->samples8) {
+				sample ^= 0x80;	// two's complement -> offset binary, same as + 128
+			}
+			offset = 128.0f;
+		}
+	} else if (sample_bytes == 2) {
+		volume->bytes_per_sample = 2;
+		volume->samples16.resize(voxel_count);
+		is_read = ReadSamples(file, volume->samples16.data(), voxel_count * 2);
+		if (is_read && needs_swap) {
+			SwapBytes(volume->samples16);
+		}
+		if (is_read && info.IsSigned()) {
+			for (uint16_t& sample : volume->samples16) {
+				sample ^= 0x8000;
+			}
+			offset = 32768.0f;
+		}
+	} else {
+		// float: find the range first, then quantize to 16 bits over it
+		std::vector<float> values(voxel_count);
+		is_read = ReadSamples(file, values.data(), voxel_count * 4);
+		if (is_read) {
+			if (needs_swap) {
+				SwapBytes(values);
+			}
+			glm::vec2 range = info.value_range;
+			if (!info.has_value_range) {
+				range = glm::vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+				for (float value : values) {
+					if (std::isfinite(value)) {
+						range.x = std::min(range.x, value);
+						range.y = std::max(range.y, value);
+					}
+				}
+				if (range.x > range.y) {
+					range = glm::vec2(0.0f, 1.0f);
+				}
+			}
+			const float to_sample = range.y > range.x ? 65535.0f / (range.y - range.x) : 0.0f;
+			volume->bytes_per_sample = 2;
+			volume->samples16.resize(voxel_count);
+			for (size_t i = 0; i < voxel_count; i++) {
+				const float value = std::isfinite(values[i]) ? values[i] : range.x;
+				volume->samples16[i] = static_cast<uint16_t>(std::clamp((value - range.x) * to_sample, 0.0f, 65535.0f) + 0.5f);
+			}
+			volume->value_range = range;
+			volume->scale = 1.0f / 65535.0f;
+			volume->bias = 0.0f;
+		}
+	}
+	if (!is_read) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "Cannot read " + std::to_string(voxel_count * sample_bytes) + " bytes from " + raw_path);
+		return nullptr;
+	}
+
+	if (sample_bytes != 4) {
+		glm::vec2 range = info.value_range;
+		if (!info.has_value_range && info.sample_type != "unsigned char") {
+			uint32_t low = volume->GetMaxSample(), high = 0;
+			for (size_t i = 0; i < voxel_count; i++) {
+				const uint32_t sample = volume->GetSample(i);
+				low = std::min(low, sample);
+				high = std::max(high, sample);
+			}
+			range = low <= high ? glm::vec2(low - offset, high - offset) : glm::vec2(0.0f, 1.0f);
+		}
+		// normalized = (sample - offset - min) / (max - min)
+		const float extent = range.y - range.x;
+		volume->value_range = range;
+		volume->scale = extent > 0.0f ? 1.0f / extent : 0.0f;
+		volume->bias = extent > 0.0f ? -(offset + range.x) / extent : 0.0f;
+	}
+
+	volume->version = NextVersion();
+	return layout == VOLUME_LAYOUT_LINEAR ? volume : volume->WithLayout(layout);
+}
+
+std::shared_ptr<RawVolume> RawVolume::WithLayout(VolumeLayout layout) const {
+	auto volume = std::make_shared<RawVolume>(*this);
+	volume->voxel_layout.Build(resolution, layout, INT32_MAX);
+	if (volume->voxel_layout.GetLayout() == GetLayout()) {
+		return volume;
+	}
+
+	// Padding voxels are never read, they stay 0
+	const size_t storage_voxels = volume->voxel_layout.GetStorageVoxels();
+	volume->samples8.assign(samples8.empty() ? 0 : storage_voxels, 0);
+	volume->samples16.assign(samples16.empty() ? 0 : storage_voxels, 0);
+	for (int z = 0; z < resolution.z; z++) {
+		for (int y = 0; y < resolution.y; y++) {
+			for (int x = 0; x < resolution.x; x++) {
+				const size_t from = Index(x, y, z), to = volume->Index(x, y, z);
+				if (bytes_per_sample == 1) {
+					volume->samples8[to] = samples8[from];
+				} else {
+					volume->samples16[to] = samples16[from];
+				}
+			}
+		}
+	}
+	return volume;
+}
+
+std::shared_ptr<RawVolume> RawVolume::Remap(const std::vector<float>& lookup) const {
+	auto volume = std::make_shared<RawVolume>(*this);
+	volume->version = NextVersion();
+	if (lookup.empty()) {
+		return volume;
+	}
+
+	// One entry per stored sample, the remapped samples use the full range with scale 1 / max and no bias
+	const uint32_t max_sample = GetMaxSample();
+	const float last = static_cast<float>(lookup.size() - 1);
+	std::vector<uint16_t> table(max_sample + 1);
+	for (uint32_t sample = 0; sample <= max_sample; sample++) {
+		const float position = Normalize(static_cast<float>(sample)) * last;
+		const size_t low = std::min(static_cast<size_t>(position), lookup.size() - 1);
+		const size_t high = std::min(low + 1, lookup.size() - 1);
+		const float value = std::clamp(glm::mix(lookup[low], lookup[high], position - low), 0.0f, 1.0f);
+		table[sample] = static_cast<uint16_t>(value * max_sample + 0.5f);
+	}
+	for (uint8_t& sample : volume->samples8) {
+		sample = static_cast<uint8_t>(table[sample]);
+	}
+	for (uint16_t& sample : volume->samples16) {
+		sample = table[sample];
+	}
+	volume->scale = 1.0f / max_sample;
+	volume->bias = 0.0f;
+	return volume;
+}
+
+float RawVolume::Fetch(int x, int y, int z) const {
+	return Normalize(static_cast<float>(FetchStored(x, y, z)));
+}
+
+glm::vec3 RawVolume::FetchGradient(int x, int y, int z, float max_gradient) const {
+	glm::vec3 gradient(
+		(Fetch(x + 1, y, z) - Fetch(x - 1, y, z)) * 0.5f,
+		(Fetch(x, y + 1, z) - Fetch(x, y - 1, z)) * 0.5f,
+		(Fetch(x, y, z + 1) - Fetch(x, y, z - 1)) * 0.5f);
+	gradient = gradient * 255.0f / max_gradient;
+	const float length = glm::length(gradient);
+	return length > 1.0f ? gradient / length : gradient;
+}
+
+std::vector<glm::vec4> RawVolume::BuildTexels(float max_gradient) const {
+	std::vector<glm::vec4> texels(GetVoxelCount());
+	for (int z = 0; z < resolution.z; z++) {
+		for (int y = 0; y < resolution.y; y++) {
+			for (int x = 0; x < resolution.x; x++) {
+				texels[LinearIndex(x, y, z)] = glm::vec4(FetchGradient(x, y, z, max_gradient), GetValue(Index(x, y, z)));
+			}
+		}
+	}
+	return texels;
+}
+
+uint32_t RawVolume::FetchStored(int x, int y, int z) const {
+	x = std::clamp(x, 0, resolution.x - 1);
+	y = std::clamp(y, 0, resolution.y - 1);
+	z = std::clamp(z, 0, resolution.z - 1);
+	return GetSample(Index(x, y, z));
+}
+
+float RawVolume::SampleStored(const glm::vec3& tex_coord) const {
+	// Texel centers are at (i + 0.5) / N, same as OpenGL.
+	const float px = tex_coord.x * resolution.x - 0.5f;
+	const float py = tex_coord.y * resolution.y - 0.5f;
+	const float pz = tex_coord.z * resolution.z - 0.5f;
+	const int x0 = static_cast<int>(std::floor(px));
+	const int y0 = static_cast<int>(std::floor(py));
+	const int z0 = static_cast<int>(std::floor(pz));
+	const float fx = px - x0;
+	const float fy = py - y0;
+	const float fz = pz - z0;
+
+	auto fetch = [&](int x, int y, int z) { return static_cast<float>(FetchStored(x, y, z)); };
+	const float c00 = glm::mix(fetch(x0, y0, z0), fetch(x0 + 1, y0, z0), fx);
+	const float c10 = glm::mix(fetch(x0, y0 + 1, z0), fetch(x0 + 1, y0 + 1, z0), fx);
+	const float c01 = glm::mix(fetch(x0, y0, z0 + 1), fetch(x0 + 1, y0, z0 + 1), fx);
+	const float c11 = glm::mix(fetch(x0, y0 + 1, z0 + 1), fetch(x0 + 1, y0 + 1, z0 + 1), fx);
+	return glm::mix(glm::mix(c00, c10, fy), glm::mix(c01, c11, fy), fz);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "VoxelLayout.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Header of a .inf file. Both "Resolution=149:208:110" and "resolution=256x256x256" styles are accepted.
+// An optional "ValueRange=min:max" (or "Min=" and "Max=") gives the range the samples are normalized by.
+struct VolumeInfo {
+	glm::ivec3 resolution = glm::ivec3(0);
+	glm::vec3 ratio = glm::vec3(1.0f);
+	std::string sample_type = "unsigned char";
+	bool is_big_endian = false;
+	bool has_value_range = false;
+	glm::vec2 value_range = glm::vec2(0.0f, 255.0f);
+
+	static bool Load(const std::string& path, VolumeInfo& info);
+	size_t GetSampleBytes() const;
+	bool IsSigned() const { return sample_type == "char" || sample_type == "short"; }
+};
+
+// Scalar samples of a .raw file, read straight from the disk without any GL context.
+// 8 and 16-bit samples keep their width (signed ones are offset by 128 / 32768 so they sort like the values),
+// float samples are quantized to 16 bits over the value range. The normalized value is sample * scale + bias,
+// clamped to [0, 1]. Without a range in the .inf, unsigned char uses 0 ~ 255 like the engine and every other
+// type the min / max of the data.
+// The samples are stored in a VoxelLayout like VolumeData, so every kernel going through Index() benefits from the
+// Morton or bricked order. Arrays the size of GetVoxelCount(), textures included, use LinearIndex() instead.
+class RawVolume {
+public:
+	// Returns nullptr if the file is missing or too short, or has more voxels than the int32 offsets reach.
+	static std::shared_ptr<RawVolume> Load(const std::string& raw_path, const VolumeInfo& info, VolumeLayout layout = VOLUME_LAYOUT_LINEAR);
+	// Copy with the samples in another layout. Same samples, so it keeps the version and caches built from it stay valid.
+	std::shared_ptr<RawVolume> WithLayout(VolumeLayout layout) const;
+	// Copy with every normalized value v replaced by lookup at v * (lookup.size() - 1), interpolated linearly.
+	// The copy has its own version. Used to follow the engine when it remaps its volume, e.g. by histogram equalization.
+	std::shared_ptr<RawVolume> Remap(const std::vector<float>& lookup) const;
+
+	// Where the sample of (x, y, z) is stored, for GetSample() and GetValue()
+	size_t Index(int x, int y, int z) const { return voxel_layout.Index(x, y, z); }
+	// x-major like the file
+	size_t LinearIndex(int x, int y, int z) const {
+		return (static_cast<size_t>(z) * resolution.y + y) * resolution.x + x;
+	}
+	uint32_t GetSample(size_t index) const { return bytes_per_sample == 1 ? samples8[index] : samples16[index]; }
+	float GetValue(size_t index) const { return Normalize(GetSample(index)); }
+	float Normalize(float sample) const {
+		const float value = sample * scale + bias;
+		return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	}
+	// Clamp-to-edge fetch and trilinear sample of the normalized value, tex_coord is in [0, 1] like texture() in GLSL.
+	float Fetch(int x, int y, int z) const;
+	// Central differences in the 0 ~ 255 value range divided by max_gradient and clamped to length 1,
+	// the gradient the engine and VolumeSequence put into the rgb of the volume texture.
+	glm::vec3 FetchGradient(int x, int y, int z, float max_gradient) const;
+	float Sample(const glm::vec3& tex_coord) const { return Normalize(SampleStored(tex_coord)); }
+	// (FetchGradient(), value) of every voxel in LinearIndex() order, the texels of the engine's volume texture
+	std::vector<glm::vec4> BuildTexels(float max_gradient) const;
+	// The same on the stored samples, before Normalize()
+	uint32_t FetchStored(int x, int y, int z) const;
+	float SampleStored(const glm::vec3& tex_coord) const;
+
+	VolumeLayout GetLayout() const { return voxel_layout.GetLayout(); }
+	int GetBytesPerSample() const { return bytes_per_sample; }
+	uint32_t GetMaxSample() const { return bytes_per_sample == 1 ? 255u : 65535u; }
+	float GetScale() const { return scale; }
+	float GetBias() const { return bias; }
+	// In the units of the file
+	const glm::vec2& GetValueRange() const { return value_range; }
+	const glm::ivec3& GetResolution() const { return resolution; }
+	const glm::vec3& GetRatio() const { return ratio; }
+	size_t GetVoxelCount() const { return static_cast<size_t>(resolution.x) * resolution.y * resolution.z; }
+	// Padding of the layout included
+	size_t GetMemorySize() const { return samples8.size() + samples16.size() * sizeof(uint16_t); }
+	// Changes every time a volume is loaded, so caches built from it can tell them apart.
+	size_t GetVersion() const { return version; }
+
+private:
+	glm::ivec3 resolution = glm::ivec3(0);
+	glm::vec3 ratio = glm::vec3(1.0f);
+	VoxelLayout voxel_layout;
+	int bytes_per_sample = 1;
+	std::vector<uint8_t> samples8;
+	std::vector<uint16_t> samples16;
+	glm::vec2 value_range = glm::vec2(0.0f, 255.0f);
+	float scale = 1.0f / 255.0f;
+	float bias = 0.0f;
+	size_t version = 0;
+};
@@ -0,0 +1,163 @@
+// Stand-in thin client for the render server: orbits the camera around the volume, requests frames as fast as the
+// server answers them and reports latency and throughput.
+// Usage: RenderClient [port] [frames] [width] [height] [requests in flight] [camera distance]
+
+#include "RenderProtocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <numeric>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	// Column-major like glm::lookAt
+	void LookAt(const float eye[3], float out[16]) {
+		float f[3] = { -eye[0], -eye[1], -eye[2] };
+		const float f_length = std::sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+		for (float& v : f) {
+			v /= f_length;
+		}
+		// s = normalize(cross(f, up)) with up = +y, u = cross(s, f)
+		float s[3] = { -f[2], 0.0f, f[0] };
+		const float s_length = std::sqrt(s[0] * s[0] + s[2] * s[2]);
+		s[0] /= s_length;
+		s[2] /= s_length;
+		const float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+
+		std::fill(out, out + 16, 0.0f);
+		for (int i = 0; i < 3; i++) {
+			out[i * 4 + 0] = s[i];
+			out[i * 4 + 1] = u[i];
+			out[i * 4 + 2] = -f[i];
+		}
+		out[12] = -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]);
+		out[13] = -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]);
+		out[14] = f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2];
+		out[15] = 1.0f;
+	}
+
+	// Column-major like glm::perspective
+	void Perspective(float fov_y, float aspect, float z_near, float z_far, float out[16]) {
+		const float t = std::tan(fov_y / 2.0f);
+		std::fill(out, out + 16, 0.0f);
+		out[0] = 1.0f / (aspect * t);
+		out[5] = 1.0f / t;
+		out[10] = -(z_far + z_near) / (z_far - z_near);
+		out[11] = -1.0f;
+		out[14] = -(2.0f * z_far * z_near) / (z_far - z_near);
+	}
+
+	double Percentile(std::vector<double> values, double fraction) {
+		if (values.empty()) {
+			return 0.0;
+		}
+		std::sort(values.begin(), values.end());
+		return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+	}
+}
+
+int main(int argc, char** argv) {
+	const uint16_t port = argc > 1 ? static_cast<uint16_t>(std::atoi(argv[1])) : kRenderServerDefaultPort;
+	const uint32_t frame_count = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 200;
+	const int width = argc > 3 ? std::atoi(argv[3]) : 800;
+	const int height = argc > 4 ? std::atoi(argv[4]) : 600;
+	const uint32_t in_flight = argc > 5 ? std::max(1, std::atoi(argv[5])) : 1;
+	const float distance = argc > 6 ? static_cast<float>(std::atof(argv[6])) : 400.0f;
+
+	if (!InitializeSockets()) {
+		std::printf("Cannot initialize sockets.\n");
+		return 1;
+	}
+	const SocketHandle server = ConnectLocal(port);
+	if (server == kInvalidSocket) {
+		std::printf("Cannot connect to 127.0.0.1:%u.\n", port);
+		return 1;
+	}
+
+	// A grey ramp which hides the lowest values
+	std::vector<float> colormap(256 * 4);
+	for (int i = 0; i < 256; i++) {
+		const float value = i / 255.0f;
+		colormap[i * 4] = value;
+		colormap[i * 4 + 1] = value;
+		colormap[i * 4 + 2] = value;
+		colormap[i * 4 + 3] = i > 60 ? value * 0.1f : 0.0f;
+	}
+	WriteMessage(server, RENDER_MESSAGE_TRANSFER_FUNCTION, colormap.data(), colormap.size() * sizeof(float));
+
+	FrameCodec codec;
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+	std::map<uint32_t, Clock::time_point> sent_times;
+	std::vector<double> latencies;
+	size_t received = 0, dropped = 0, wire_bytes = 0, decode_errors = 0;
+	double render_time = 0.0, encode_time = 0.0;
+
+	uint32_t next_id = 1, last_answered = 0;
+	RenderMessageHeader header;
+	std::vector<uint8_t> payload;
+	const auto start = Clock::now();
+	while (last_answered < frame_count) {
+		// Keep up to in_flight requests outstanding, each one with the camera a bit further around the orbit
+		if (next_id <= frame_count && next_id - last_answered <= in_flight) {
+			const float angle = next_id * 0.02f;
+			CameraMessage camera;
+			camera.view_position[0] = std::sin(angle) * distance;
+			camera.view_position[1] = distance * 0.3f;
+			camera.view_position[2] = std::cos(angle) * distance;
+			LookAt(camera.view_position, camera.view);
+			Perspective(0.785398f, static_cast<float>(width) / height, 0.1f, distance * 4.0f, camera.projection);
+			camera.width = width;
+			camera.height = height;
+			const FrameRequestMessage request{ next_id };
+			sent_times[next_id] = Clock::now();
+			if (!WriteMessage(server, RENDER_MESSAGE_CAMERA, &camera, sizeof(camera))
+				|| !WriteMessage(server, RENDER_MESSAGE_FRAME_REQUEST, &request, sizeof(request))) {
+				std::printf("Connection lost.\n");
+				break;
+			}
+			next_id++;
+			continue;
+		}
+
+		if (!ReadMessage(server, header, payload)) {
+			std::printf("Connection lost.\n");
+			break;
+		}
+		if (header.type != RENDER_MESSAGE_FRAME || payload.size() < sizeof(FrameMessage)) {
+			continue;
+		}
+		FrameMessage frame;
+		std::copy(payload.begin(), payload.begin() + sizeof(frame), reinterpret_cast<uint8_t*>(&frame));
+		const auto now = Clock::now();
+
+		pixels.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+		if (!codec.Decode(payload.data() + sizeof(frame), payload.size() - sizeof(frame), static_cast<FrameEncoding>(frame.encoding), frame.width, frame.height, pixels.data())) {
+			decode_errors++;
+		}
+		latencies.push_back(std::chrono::duration<double, std::milli>(now - sent_times[frame.request_id]).count());
+		sent_times.erase(sent_times.begin(), sent_times.upper_bound(frame.request_id));
+		last_answered = frame.request_id;
+		received++;
+		dropped += frame.dropped;
+		wire_bytes += sizeof(header) + payload.size();
+		render_time += frame.render_time;
+		encode_time += frame.encode_time;
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	CloseSocket(server);
+
+	const double raw_bytes = static_cast<double>(received) * width * height * 4;
+	std::printf("%zu frames (%zu requests coalesced, %zu decode errors) in %.2f s: %.1f fps, %.2f MB/s\n",
+		received, dropped, decode_errors, seconds, received / seconds, wire_bytes / seconds / 1048576.0);
+	std::printf("latency: mean %.2f ms, p50 %.2f ms, p95 %.2f ms\n",
+		latencies.empty() ? 0.0 : std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size(), Percentile(latencies, 0.5), Percentile(latencies, 0.95));
+	std::printf("server: render %.2f ms, encode %.2f ms per frame, compression %.1f : 1\n",
+		received ? render_time / received : 0.0, received ? encode_time / received : 0.0, wire_bytes ? raw_bytes / wire_bytes : 0.0);
+	return decode_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+#include "RenderProtocol.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// PackBits on whole pixels: a control byte below 128 is followed by (c + 1) literal pixels,
+	// otherwise by one pixel repeated (c - 126) times.
+	const int kMaxLiteral = 128;
+	const int kMaxRun = 129;
+	// Larger than any frame the server sends, anything bigger is a broken stream
+	const uint32_t kMaxMessageSize = 256u << 20;
+
+	bool SamePixel(const uint8_t* a, const uint8_t* b) {
+		return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+	}
+
+	void RunLengthEncode(const uint8_t* pixels, size_t count, std::vector<uint8_t>& out) {
+		size_t i = 0;
+		while (i < count) {
+			size_t run = 1;
+			while (i + run < count && run < kMaxRun && SamePixel(pixels + (i + run) * 3, pixels + i * 3)) {
+				run++;
+			}
+			if (run >= 2) {
+				out.push_back(static_cast<uint8_t>(128 + run - 2));
+				out.insert(out.end(), pixels + i * 3, pixels + i * 3 + 3);
+				i += run;
+				continue;
+			}
+
+			const size_t start = i;
+			size_t literal = 0;
+			while (i < count && literal < kMaxLiteral) {
+				if (i + 1 < count && SamePixel(pixels + (i + 1) * 3, pixels + i * 3)) {
+					break;
+				}
+				i++;
+				literal++;
+			}
+			out.push_back(static_cast<uint8_t>(literal - 1));
+			out.insert(out.end(), pixels + start * 3, pixels + i * 3);
+		}
+	}
+
+	bool RunLengthDecode(const uint8_t* data, size_t size, size_t count, uint8_t* pixels) {
+		size_t read = 0, written = 0;
+		while (written < count) {
+			if (read >= size) {
+				return false;
+			}
+			const uint8_t control = data[read++];
+			if (control < 128) {
+				const size_t literal = static_cast<size_t>(control) + 1;
+				if (written + literal > count || read + literal * 3 > size) {
+					return false;
+				}
+				std::memcpy(pixels + written * 3, data + read, literal * 3);
+				read += literal * 3;
+				written += literal;
+			} else {
+				const size_t run = static_cast<size_t>(control) - 126;
+				if (written + run > count || read + 3 > size) {
+					return false;
+				}
+				for (size_t i = 0; i < run; i++) {
+					std::memcpy(pixels + (written + i) * 3, data + read, 3);
+				}
+				read += 3;
+				written += run;
+			}
+		}
+		return read == size;
+	}
+
+	bool SendAll(SocketHandle socket, const void* data, size_t size) {
+		const char* bytes = static_cast<const char*>(data);
+#ifdef MSG_NOSIGNAL
+		const int flags = MSG_NOSIGNAL;
+#else
+		const int flags = 0;
+#endif
+		while (size > 0) {
+			const int chunk = static_cast<int>(size < (1u << 30) ? size : (1u << 30));
+			const auto sent = send(socket, bytes, chunk, flags);
+			if (sent <= 0) {
+				return false;
+			}
+			bytes += sent;
+			size -= static_cast<size_t>(sent);
+		}
+		return true;
+	}
+
+	bool ReceiveAll(SocketHandle socket, void* data, size_t size) {
+		char* bytes = static_cast<char*>(data);
+		while (size > 0) {
+			const int chunk = static_cast<int>(size < (1u << 30) ? size : (1u << 30));
+			const auto received = recv(socket, bytes, chunk, 0);
+			if (received <= 0) {
+				return false;
+			}
+			bytes += received;
+			size -= static_cast<size_t>(received);
+		}
+		return true;
+	}
+
+	void SetNoDelay(SocketHandle socket) {
+		// Frames and requests are small and latency matters more than packet count
+		int enable = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+#ifdef SO_NOSIGPIPE
+		setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+	}
+
+	sockaddr_in LoopbackAddress(uint16_t port) {
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return address;
+	}
+}
+
+FrameEncoding FrameCodec::Encode(const unsigned char* pixels, int width, int height, std::vector<uint8_t>& out) {
+	const size_t count = static_cast<size_t>(width) * height;
+	current.resize(count * 3);
+	for (size_t i = 0; i < count; i++) {
+		current[i * 3] = pixels[i * 4];
+		current[i * 3 + 1] = pixels[i * 4 + 1];
+		current[i * 3 + 2] = pixels[i * 4 + 2];
+	}
+
+	out.clear();
+	FrameEncoding encoding = FRAME_ENCODING_RLE;
+	if (previous.size() == current.size()) {
+		// Unchanged pixels become zero and collapse into long runs
+		std::vector<uint8_t>& delta = previous;
+		for (size_t i = 0; i < delta.size(); i++) {
+			delta[i] = static_cast<uint8_t>(current[i] - delta[i]);
+		}
+		RunLengthEncode(delta.data(), count, out);
+		encoding = FRAME_ENCODING_DELTA_RLE;
+	} else {
+		RunLengthEncode(current.data(), count, out);
+	}
+	previous.swap(current);
+	return encoding;
+}
+
+bool FrameCodec::Decode(const uint8_t* data, size_t size, FrameEncoding encoding, int width, int height, unsigned char* pixels) {
+	const size_t count = static_cast<size_t>(width) * height;
+	current.resize(count * 3);
+	if (!RunLengthDecode(data, size, count, current.data())) {
+		return false;
+	}
+	if (encoding == FRAME_ENCODING_DELTA_RLE) {
+		if (previous.size() != current.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < current.size(); i++) {
+			current[i] = static_cast<uint8_t>(current[i] + previous[i]);
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		pixels[i * 4] = current[i * 3];
+		pixels[i * 4 + 1] = current[i * 3 + 1];
+		pixels[i * 4 + 2] = current[i * 3 + 2];
+		pixels[i * 4 + 3] = 255;
+	}
+	previous.swap(current);
+	return true;
+}
+
+bool InitializeSockets() {
+#ifdef _WIN32
+	static const bool is_initialized = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return is_initialized;
+#else
+	return true;
+#endif
+}
+
+SocketHandle ListenLocal(uint16_t port) {
+	const SocketHandle listener = static_cast<SocketHandle>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (listener == kInvalidSocket) {
+		return kInvalidSocket;
+	}
+	int enable = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+	const sockaddr_in address = LoopbackAddress(port);
+	if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0) {
+		CloseSocket(listener);
+		return kInvalidSocket;
+	}
+	return listener;
+}
+
+SocketHandle AcceptClient(SocketHandle listener) {
+	const SocketHandle client = static_cast<SocketHandle>(accept(listener, nullptr, nullptr));
+	if (client != kInvalidSocket) {
+		SetNoDelay(client);
+	}
+	return client;
+}
+
+SocketHandle ConnectLocal(uint16_t port) {
+	const SocketHandle client = static_cast<SocketHandle>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (client == kInvalidSocket) {
+		return kInvalidSocket;
+	}
+	const sockaddr_in address = LoopbackAddress(port);
+	if (connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		CloseSocket(client);
+		return kInvalidSocket;
+	}
+	SetNoDelay(client);
+	return client;
+}
+
+void ShutdownSocket(SocketHandle socket) {
+#ifdef _WIN32
+	shutdown(socket, SD_BOTH);
+#else
+	shutdown(socket, SHUT_RDWR);
+#endif
+}
+
+void CloseSocket(SocketHandle socket) {
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	close(socket);
+#endif
+}
+
+bool WriteMessage(SocketHandle socket, RenderMessageType type, const void* payload, size_t size) {
+	return WriteMessage(socket, type, payload, size, nullptr, 0);
+}
+
+bool WriteMessage(SocketHandle socket, RenderMessageType type, const void* first, size_t first_size, const void* second, size_t second_size) {
+	const RenderMessageHeader header{ kRenderProtocolMagic, type, static_cast<uint32_t>(first_size + second_size) };
+	return SendAll(socket, &header, sizeof(header))
+		&& (first_size == 0 || SendAll(socket, first, first_size))
+		&& (second_size == 0 || SendAll(socket, second, second_size));
+}
+
+bool ReadMessage(SocketHandle socket, RenderMessageHeader& header, std::vector<uint8_t>& payload) {
+	if (!ReceiveAll(socket, &header, sizeof(header)) || header.magic != kRenderProtocolMagic || header.size > kMaxMessageSize) {
+		return false;
+	}
+	payload.resize(header.size);
+	return header.size == 0 || ReceiveAll(socket, payload.data(), header.size);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Wire format between RenderServer and its clients, shared by both sides.
+// Every message is a RenderMessageHeader followed by `size` bytes of payload. Both ends run on the same machine,
+// so the structs are sent as they are in memory.
+
+const uint32_t kRenderProtocolMagic = 0x31535256;	// "VRS1"
+const uint16_t kRenderServerDefaultPort = 27015;
+
+enum RenderMessageType : uint32_t {
+	RENDER_MESSAGE_CAMERA = 1,			// client -> server, CameraMessage
+	RENDER_MESSAGE_TRANSFER_FUNCTION,	// client -> server, RGBA floats like TransferFunctionWidget::get_colormapf()
+	RENDER_MESSAGE_ISO_VALUE,			// client -> server, IsoValueMessage
+	RENDER_MESSAGE_FRAME_REQUEST,		// client -> server, FrameRequestMessage
+	RENDER_MESSAGE_FRAME,				// server -> client, FrameMessage followed by the encoded pixels
+};
+
+struct RenderMessageHeader {
+	uint32_t magic;
+	uint32_t type;
+	uint32_t size;
+};
+
+// Column-major matrices like glm
+struct CameraMessage {
+	float view[16];
+	float projection[16];
+	float view_position[3];
+	int32_t width;
+	int32_t height;
+};
+
+// Switches the server to iso surface rendering, iso_value is in 0..255. A transfer function switches back to ray casting.
+struct IsoValueMessage {
+	float iso_value;
+};
+
+struct FrameRequestMessage {
+	uint32_t request_id;
+};
+
+struct FrameMessage {
+	uint32_t request_id;	// the newest request this frame answers
+	uint32_t dropped;		// older requests coalesced into this frame
+	int32_t width;
+	int32_t height;
+	uint32_t encoding;		// FrameEncoding
+	float render_time;		// ms
+	float encode_time;		// ms
+};
+
+enum FrameEncoding : uint32_t {
+	FRAME_ENCODING_RLE,			// run-length coded RGB
+	FRAME_ENCODING_DELTA_RLE,	// run-length coded RGB difference to the previous frame
+};
+
+// Run-length coding of RGB pixels, optionally against the previous frame so a still camera costs almost nothing.
+// Both sides keep one codec per connection and see the same frames in the same order.
+class FrameCodec {
+public:
+	// pixels are RGBA8, alpha is not sent
+	FrameEncoding Encode(const unsigned char* pixels, int width, int height, std::vector<uint8_t>& out);
+	// Writes RGBA8 with alpha 255. Returns false on malformed data.
+	bool Decode(const uint8_t* data, size_t size, FrameEncoding encoding, int width, int height, unsigned char* pixels);
+	// Forget the previous frame, the next one is coded on its own
+	void Reset() { previous.clear(); }
+
+private:
+	std::vector<uint8_t> previous;	// RGB of the last frame
+	std::vector<uint8_t> current;
+};
+
+// Minimal blocking socket helpers over TCP on the loopback interface.
+#ifdef _WIN32
+using SocketHandle = uintptr_t;
+#else
+using SocketHandle = int;
+#endif
+const SocketHandle kInvalidSocket = static_cast<SocketHandle>(-1);
+
+bool InitializeSockets();
+// Listen on 127.0.0.1:port.
+SocketHandle ListenLocal(uint16_t port);
+SocketHandle AcceptClient(SocketHandle listener);
+SocketHandle ConnectLocal(uint16_t port);
+// Wake up any thread blocked on the socket.
+void ShutdownSocket(SocketHandle socket);
+void CloseSocket(SocketHandle socket);
+
+bool WriteMessage(SocketHandle socket, RenderMessageType type, const void* payload, size_t size);
+// Write a message whose payload is two parts, to send a FrameMessage and its pixels without copying them together.
+bool WriteMessage(SocketHandle socket, RenderMessageType type, const void* first, size_t first_size, const void* second, size_t second_size);
+bool ReadMessage(SocketHandle socket, RenderMessageHeader& header, std::vector<uint8_t>& payload);
@@ -0,0 +1,278 @@
+#include "RenderServer.h"
+#include "Logger.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace {
+	// Frames larger than this are refused, the client can ask again with a smaller size
+	const int kMaxFrameSize = 4096;
+}
+
+RenderServer::RenderServer(unsigned int render_threads) : scheduler(render_threads), ray_caster(scheduler), iso_renderer(scheduler) {
+}
+
+RenderServer::~RenderServer() {
+	Stop();
+}
+
+bool RenderServer::Start(uint16_t port) {
+	if (is_running) {
+		return true;
+	}
+	if (!InitializeSockets()) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "Render server: the socket library could not be initialized.");
+		return false;
+	}
+	listener = ListenLocal(port);
+	if (listener == kInvalidSocket) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "Render server: cannot listen on 127.0.0.1:" + std::to_string(port) + ".");
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats = Stats();
+		requested_id = 0;
+		pending_requests = 0;
+	}
+	is_running = true;
+	network_thread = std::thread(&RenderServer::NetworkLoop, this);
+	render_thread = std::thread(&RenderServer::RenderLoop, this);
+	Nexus::Logger::Message(Nexus::LOG_INFO, "Render server: listening on 127.0.0.1:" + std::to_string(port) + ".");
+	return true;
+}
+
+void RenderServer::Stop() {
+	if (!is_running) {
+		return;
+	}
+	is_running = false;
+
+	// Unblock accept() and recv(), then the render thread
+#ifdef _WIN32
+	// shutdown() does not wake up accept() on Winsock, closing the socket does
+	CloseSocket(listener);
+#else
+	ShutdownSocket(listener);
+#endif
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (client != kInvalidSocket) {
+			ShutdownSocket(client);
+		}
+	}
+	condition.notify_all();
+
+	network_thread.join();
+	render_thread.join();
+#ifndef _WIN32
+	CloseSocket(listener);
+#endif
+	listener = kInvalidSocket;
+	Nexus::Logger::Message(Nexus::LOG_INFO, "Render server: stopped.");
+}
+
+void RenderServer::SetVolume(std::shared_ptr<const VolumeData> new_volume, const glm::vec3& volume_size) {
+	std::lock_guard<std::mutex> lock(mutex);
+	volume = std::move(new_volume);
+	state.view.volume_size = volume_size;
+	if (!state.has_camera) {
+		SetDefaultCamera(state);
+	}
+	condition.notify_one();
+}
+
+void RenderServer::SetDefaults(const std::vector<float>& colormap, const glm::vec3& background_color, const glm::vec3& light_color) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (state.colormap.empty()) {
+		state.colormap = colormap;
+	}
+	state.view.background_color = background_color;
+	state.view.light_color = light_color;
+}
+
+RenderServer::Stats RenderServer::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void RenderServer::NetworkLoop() {
+	RenderMessageHeader header;
+	std::vector<uint8_t> payload;
+	while (is_running) {
+		const SocketHandle accepted = AcceptClient(listener);
+		if (accepted == kInvalidSocket) {
+			if (is_running) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			client = accepted;
+			needs_keyframe = true;
+			stats.is_client_connected = true;
+		}
+		Nexus::Logger::Message(Nexus::LOG_INFO, "Render server: client connected.");
+
+		while (is_running && ReadMessage(accepted, header, payload)) {
+			HandleMessage(header, payload);
+		}
+
+		{
+			std::lock_guard<std::mutex> send_lock(send_mutex);
+			std::lock_guard<std::mutex> lock(mutex);
+			client = kInvalidSocket;
+			stats.is_client_connected = false;
+			// The next client must not receive frames requested by this one
+			requested_id = 0;
+			pending_requests = 0;
+			CloseSocket(accepted);
+		}
+		Nexus::Logger::Message(Nexus::LOG_INFO, "Render server: client disconnected.");
+	}
+}
+
+void RenderServer::HandleMessage(const RenderMessageHeader& header, const std::vector<uint8_t>& payload) {
+	std::lock_guard<std::mutex> lock(mutex);
+	switch (header.type) {
+		case RENDER_MESSAGE_CAMERA: {
+			if (payload.size() != sizeof(CameraMessage)) {
+				break;
+			}
+			CameraMessage camera;
+			std::memcpy(&camera, payload.data(), sizeof(camera));
+			if (camera.width <= 0 || camera.height <= 0 || camera.width > kMaxFrameSize || camera.height > kMaxFrameSize) {
+				break;
+			}
+			std::memcpy(&state.view.view[0][0], camera.view, sizeof(camera.view));
+			std::memcpy(&state.view.projection[0][0], camera.projection, sizeof(camera.projection));
+			state.view.view_position = glm::vec3(camera.view_position[0], camera.view_position[1], camera.view_position[2]);
+			// The point light follows the camera like in the application window
+			state.view.light_position = state.view.view_position;
+			state.view.width = camera.width;
+			state.view.height = camera.height;
+			state.has_camera = true;
+			break;
+		}
+		case RENDER_MESSAGE_TRANSFER_FUNCTION:
+			if (payload.empty() || payload.size() % (4 * sizeof(float)) != 0) {
+				break;
+			}
+			state.colormap.resize(payload.size() / sizeof(float));
+			std::memcpy(state.colormap.data(), payload.data(), payload.size());
+			state.use_iso_surface = false;
+			break;
+		case RENDER_MESSAGE_ISO_VALUE:
+			if (payload.size() != sizeof(IsoValueMessage)) {
+				break;
+			}
+			IsoValueMessage iso;
+			std::memcpy(&iso, payload.data(), sizeof(iso));
+			state.iso_value = iso.iso_value;
+			state.use_iso_surface = true;
+			break;
+		case RENDER_MESSAGE_FRAME_REQUEST:
+			if (payload.size() != sizeof(FrameRequestMessage)) {
+				break;
+			}
+			FrameRequestMessage request;
+			std::memcpy(&request, payload.data(), sizeof(request));
+			requested_id = request.request_id;
+			pending_requests++;
+			stats.requests++;
+			condition.notify_one();
+			break;
+		default:
+			break;
+	}
+}
+
+void RenderServer::RenderLoop() {
+	FrameCodec codec;
+	std::vector<unsigned char> pixels;
+	std::vector<uint8_t> encoded;
+
+	while (true) {
+		RenderState frame_state;
+		std::shared_ptr<const VolumeData> frame_volume;
+		FrameMessage frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] { return !is_running || (pending_requests > 0 && volume && client != kInvalidSocket); });
+			if (!is_running) {
+				return;
+			}
+			// Everything requested so far is answered by this one frame
+			frame.request_id = requested_id;
+			frame.dropped = static_cast<uint32_t>(pending_requests - 1);
+			stats.frames_dropped += pending_requests - 1;
+			pending_requests = 0;
+
+			frame_state = state;
+			frame_volume = volume;
+			if (needs_keyframe) {
+				codec.Reset();
+				needs_keyframe = false;
+			}
+		}
+		if (frame_state.view.width <= 0 || frame_state.view.height <= 0) {
+			continue;
+		}
+
+		const CpuRenderView& view = frame_state.view;
+		pixels.resize(static_cast<size_t>(view.width) * view.height * 4);
+		if (frame_state.use_iso_surface) {
+			iso_renderer.Render(*frame_volume, view, frame_state.iso_value, pixels.data());
+			frame.render_time = iso_renderer.GetLastRenderTime();
+		} else {
+			ray_caster.Render(*frame_volume, view, frame_state.colormap, pixels.data());
+			frame.render_time = ray_caster.GetLastRenderTime();
+		}
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		frame.encoding = codec.Encode(pixels.data(), view.width, view.height, encoded);
+		const auto end = std::chrono::high_resolution_clock::now();
+		frame.encode_time = std::chrono::duration<float, std::milli>(end - start).count();
+		frame.width = view.width;
+		frame.height = view.height;
+
+		std::lock_guard<std::mutex> send_lock(send_mutex);
+		SocketHandle target;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			target = client;
+			// A new client connected while rendering, this frame was coded against the old one's history
+			if (target == kInvalidSocket || needs_keyframe) {
+				continue;
+			}
+		}
+		if (!WriteMessage(target, RENDER_MESSAGE_FRAME, &frame, sizeof(frame), encoded.data(), encoded.size())) {
+			// The network thread notices the broken connection and cleans up
+			ShutdownSocket(target);
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.frames_sent++;
+		stats.raw_bytes += pixels.size();
+		stats.sent_bytes += sizeof(RenderMessageHeader) + sizeof(frame) + encoded.size();
+		stats.last_render_time = frame.render_time;
+		stats.last_encode_time = frame.encode_time;
+	}
+}
+
+void RenderServer::SetDefaultCamera(RenderState& target) const {
+	const glm::vec3 size = target.view.volume_size;
+	const float distance = std::max(size.x, std::max(size.y, size.z)) * 2.0f;
+	target.view.width = 800;
+	target.view.height = 600;
+	target.view.view_position = glm::vec3(0.0f, 0.0f, distance);
+	target.view.light_position = target.view.view_position;
+	target.view.view = glm::lookAt(target.view.view_position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	target.view.projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, distance * 4.0f);
+}
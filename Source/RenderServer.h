@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CpuIsoRenderer.h"
+#include "CpuRay.h"
+#include "CpuRayCaster.h"
+#include "RenderProtocol.h"
+#include "TaskScheduler.h"
+#include "VolumeData.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Serves frames of the loaded volume to one local client at a time (see RenderProtocol.h and RenderClient.cpp).
+// A network thread applies camera / transfer function / iso value messages to the pending state, a render thread
+// renders it with the CPU renderers and streams the encoded frame back. Requests that arrive while a frame is being
+// rendered are coalesced, only the newest one gets a frame.
+class RenderServer {
+public:
+	struct Stats {
+		size_t requests = 0;
+		size_t frames_sent = 0;
+		size_t frames_dropped = 0;
+		size_t raw_bytes = 0;
+		size_t sent_bytes = 0;
+		float last_render_time = 0.0f;
+		float last_encode_time = 0.0f;
+		bool is_client_connected = false;
+	};
+
+	// Frames are rendered on a pool of render_threads of its own, so serving a client never waits for the UI's
+	// ParallelFor and the other way round.
+	explicit RenderServer(unsigned int render_threads);
+	~RenderServer();
+
+	RenderServer(const RenderServer&) = delete;
+	RenderServer& operator=(const RenderServer&) = delete;
+
+	bool Start(uint16_t port);
+	void Stop();
+	bool IsRunning() const { return is_running; }
+
+	// The volume must not change afterwards, the render thread reads it without a lock. Replace it with a new one instead.
+	void SetVolume(std::shared_ptr<const VolumeData> volume, const glm::vec3& volume_size);
+	// State used until the client sends its own.
+	void SetDefaults(const std::vector<float>& colormap, const glm::vec3& background_color, const glm::vec3& light_color);
+
+	Stats GetStats() const;
+
+private:
+	struct RenderState {
+		CpuRenderView view;
+		std::vector<float> colormap;
+		float iso_value = 128.0f;
+		bool use_iso_surface = false;
+		bool has_camera = false;
+	};
+
+	void NetworkLoop();
+	void RenderLoop();
+	void HandleMessage(const RenderMessageHeader& header, const std::vector<uint8_t>& payload);
+	// Looks at the volume from +z when the client has not sent a camera yet
+	void SetDefaultCamera(RenderState& target) const;
+
+	TaskScheduler scheduler;
+	CpuRayCaster ray_caster;
+	CpuIsoRenderer iso_renderer;
+
+	std::atomic<bool> is_running{ false };
+	SocketHandle listener = kInvalidSocket;
+	std::thread network_thread;
+	std::thread render_thread;
+
+	// Guards everything below
+	mutable std::mutex mutex;
+	std::condition_variable condition;
+	SocketHandle client = kInvalidSocket;
+	std::shared_ptr<const VolumeData> volume;
+	RenderState state;
+	uint32_t requested_id = 0;
+	size_t pending_requests = 0;
+	bool needs_keyframe = true;
+	Stats stats;
+
+	// Held while a frame is written, so the network thread does not close the socket under the render thread
+	std::mutex send_mutex;
+};
@@ -0,0 +1,230 @@
+#include "SliceRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	const float kSqrt3 = 1.7320508f;
+	// Oblique positions and normals are snapped to this grid before they are compared
+	const float kPositionSteps = 4096.0f;
+	const float kNormalSteps = 1000.0f;
+
+	// Orthonormal basis of an oblique plane, u and v match x and y for a +z normal
+	void GetPlaneBasis(const glm::vec3& normal, glm::vec3& u, glm::vec3& v) {
+		const glm::vec3 helper = std::abs(normal.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		u = glm::normalize(glm::cross(helper, normal));
+		v = glm::cross(normal, u);
+	}
+}
+
+std::shared_ptr<SliceImage> SliceRenderer::Render(const RawVolume& volume, const std::vector<float>& colormap, const SliceRequest& request, const glm::vec3& background) {
+	if (volume.GetVoxelCount() == 0 || colormap.empty()) {
+		return nullptr;
+	}
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const Key key = MakeKey(volume, request);
+	std::shared_ptr<const Slice> slice;
+	for (auto it = cache.begin(); it != cache.end(); ++it) {
+		if ((*it)->key == key) {
+			slice = *it;
+			cache.splice(cache.begin(), cache, it);
+			break;
+		}
+	}
+	if (slice) {
+		stats.hits++;
+	} else {
+		stats.misses++;
+		slice = Resample(volume, request, key);
+		cache.push_front(slice);
+		stats.cached_bytes += slice->GetMemorySize();
+		// Keep at least the slice just made, even if it alone is over the budget
+		while (cache.size() > 1 && stats.cached_bytes > cache_budget) {
+			stats.cached_bytes -= cache.back()->GetMemorySize();
+			cache.pop_back();
+		}
+	}
+
+	// One blended color per possible sample, 256 or 65536 entries
+	const int colormap_size = static_cast<int>(colormap.size() / 4);
+	const glm::vec3 background_color = glm::clamp(background, glm::vec3(0.0f), glm::vec3(1.0f));
+	std::vector<uint32_t> lookup(static_cast<size_t>(volume.GetMaxSample()) + 1);
+	for (size_t sample = 0; sample < lookup.size(); sample++) {
+		const float value = volume.Normalize(static_cast<float>(sample));
+		const int entry = std::min(static_cast<int>(value * (colormap_size - 1) + 0.5f), colormap_size - 1);
+		const float* rgba = colormap.data() + entry * 4;
+		const glm::vec3 color = glm::mix(background_color, glm::vec3(rgba[0], rgba[1], rgba[2]), rgba[3]);
+		unsigned char* pixel = reinterpret_cast<unsigned char*>(&lookup[sample]);
+		pixel[0] = static_cast<unsigned char>(color.x * 255.0f + 0.5f);
+		pixel[1] = static_cast<unsigned char>(color.y * 255.0f + 0.5f);
+		pixel[2] = static_cast<unsigned char>(color.z * 255.0f + 0.5f);
+		pixel[3] = 255;
+	}
+	uint32_t background_pixel;
+	{
+		unsigned char* pixel = reinterpret_cast<unsigned char*>(&background_pixel);
+		pixel[0] = static_cast<unsigned char>(background_color.x * 255.0f + 0.5f);
+		pixel[1] = static_cast<unsigned char>(background_color.y * 255.0f + 0.5f);
+		pixel[2] = static_cast<unsigned char>(background_color.z * 255.0f + 0.5f);
+		pixel[3] = 255;
+	}
+
+	auto image = std::make_shared<SliceImage>();
+	image->width = slice->width;
+	image->height = slice->height;
+	image->pixels.resize(static_cast<size_t>(slice->width) * slice->height * 4);
+	scheduler.ParallelFor(slice->height, [&](size_t y) {
+		size_t index = y * slice->width;
+		unsigned char* pixel = image->pixels.data() + index * 4;
+		for (int x = 0; x < slice->width; x++, index++, pixel += 4) {
+			const bool is_inside = slice->inside.empty() || slice->inside[index];
+			const uint32_t color = is_inside ? lookup[slice->GetSample(index)] : background_pixel;
+			std::memcpy(pixel, &color, 4);
+		}
+	});
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	last_render_time = std::chrono::duration<float, std::milli>(end - start).count();
+	return image;
+}
+
+void SliceRenderer::ClearCache() {
+	cache.clear();
+	stats.cached_bytes = 0;
+}
+
+SliceRenderer::Key SliceRenderer::MakeKey(const RawVolume& volume, const SliceRequest& request) const {
+	Key key{ volume.GetVersion(), request.axis, 0, glm::ivec3(0), 0, 0 };
+	const float position = std::clamp(request.position, 0.0f, 1.0f);
+	if (request.axis == SLICE_AXIS_OBLIQUE) {
+		key.position = static_cast<int>(std::round(position * kPositionSteps));
+		const float length = glm::length(request.normal);
+		const glm::vec3 normal = (length > 1e-6f ? request.normal / length : glm::vec3(0.0f, 0.0f, 1.0f)) * kNormalSteps;
+		key.normal = glm::ivec3(static_cast<int>(std::round(normal.x)), static_cast<int>(std::round(normal.y)), static_cast<int>(std::round(normal.z)));
+		key.width = std::max(request.width, 1);
+		key.height = std::max(request.height, 1);
+	} else {
+		const int slice_count = volume.GetResolution()[request.axis];
+		key.position = static_cast<int>(std::round(position * (slice_count - 1)));
+	}
+	return key;
+}
+
+std::shared_ptr<const SliceRenderer::Slice> SliceRenderer::Resample(const RawVolume& volume, const SliceRequest& request, const Key& key) {
+	auto slice = std::make_shared<Slice>();
+	slice->key = key;
+
+	const glm::ivec3& res = volume.GetResolution();
+	// Keep the width of the file, interpolated samples are rounded back to it
+	auto allocate = [&](size_t count) {
+		if (volume.GetBytesPerSample() == 1) {
+			slice->samples8.resize(count);
+		} else {
+			slice->samples16.resize(count);
+		}
+	};
+	auto store = [&](size_t index, float sample) {
+		if (volume.GetBytesPerSample() == 1) {
+			slice->samples8[index] = static_cast<uint8_t>(sample + 0.5f);
+		} else {
+			slice->samples16[index] = static_cast<uint16_t>(sample + 0.5f);
+		}
+	};
+
+	if (request.axis == SLICE_AXIS_OBLIQUE) {
+		slice->width = key.width;
+		slice->height = key.height;
+		allocate(static_cast<size_t>(slice->width) * slice->height);
+		slice->inside.resize(static_cast<size_t>(slice->width) * slice->height);
+
+		// Use the quantized values, so a cached slice does not depend on which request made it
+		const glm::vec3 normal = glm::normalize(glm::vec3(key.normal));
+		const float extent = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		const glm::vec3 center = glm::vec3(0.5f) + normal * ((key.position / kPositionSteps - 0.5f) * extent);
+		glm::vec3 u, v;
+		GetPlaneBasis(normal, u, v);
+
+		// The image is a square large enough to hold the plane's cut through the unit cube
+		scheduler.ParallelFor(slice->height, [&](size_t y) {
+			const glm::vec3 row = center + v * (((y + 0.5f) / slice->height - 0.5f) * kSqrt3);
+			size_t index = y * slice->width;
+			for (int x = 0; x < slice->width; x++, index++) {
+				const glm::vec3 tex_coord = row + u * (((x + 0.5f) / slice->width - 0.5f) * kSqrt3);
+				const bool is_inside = tex_coord.x >= 0.0f && tex_coord.x <= 1.0f && tex_coord.y >= 0.0f && tex_coord.y <= 1.0f
+					&& tex_coord.z >= 0.0f && tex_coord.z <= 1.0f;
+				slice->inside[index] = is_inside;
+				store(index, is_inside ? volume.SampleStored(tex_coord) : 0.0f);
+			}
+		});
+		return slice;
+	}
+
+	// Axis-aligned slices copy samples, oriented the way the orthogonal cameras in Main.cpp look at the volume
+	const int s = key.position;
+	switch (request.axis) {
+		case SLICE_AXIS_X:
+			slice->width = res.z;
+			slice->height = res.y;
+			break;
+		case SLICE_AXIS_Y:
+			slice->width = res.x;
+			slice->height = res.z;
+			break;
+		default:
+			slice->width = res.x;
+			slice->height = res.y;
+			break;
+	}
+	allocate(static_cast<size_t>(slice->width) * slice->height);
+
+	scheduler.ParallelFor(slice->height, [&](size_t row) {
+		const int y = static_cast<int>(row);
+		size_t index = row * slice->width;
+		for (int x = 0; x < slice->width; x++, index++) {
+			size_t voxel;
+			switch (request.axis) {
+				case SLICE_AXIS_X:
+					voxel = volume.Index(s, y, res.z - 1 - x);
+					break;
+				case SLICE_AXIS_Y:
+					voxel = volume.Index(x, s, res.z - 1 - y);
+					break;
+				default:
+					voxel = volume.Index(x, y, s);
+					break;
+			}
+			store(index, static_cast<float>(volume.GetSample(voxel)));
+		}
+	});
+	return slice;
+}
+
+glm::vec2 SliceRenderer::GetWorldSize(const SliceRequest& request, const glm::vec3& volume_size) {
+	switch (request.axis) {
+		case SLICE_AXIS_X:
+			return glm::vec2(volume_size.z, volume_size.y);
+		case SLICE_AXIS_Y:
+			return glm::vec2(volume_size.x, volume_size.z);
+		case SLICE_AXIS_Z:
+			return glm::vec2(volume_size.x, volume_size.y);
+		default:
+			return glm::vec2(static_cast<float>(request.width), static_cast<float>(request.height));
+	}
+}
+
+const char* SliceRenderer::GetAxisName(SliceAxis axis) {
+	switch (axis) {
+		case SLICE_AXIS_X:
+			return "X";
+		case SLICE_AXIS_Y:
+			return "Y";
+		case SLICE_AXIS_Z:
+			return "Z";
+		case SLICE_AXIS_OBLIQUE:
+			return "Oblique";
+	}
+	return "Unknown";
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "RawVolume.h"
+#include "TaskScheduler.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+enum SliceAxis {
+	SLICE_AXIS_X,		// seen from +x like DISPLAY_MODE_ORTHOGONAL_X
+	SLICE_AXIS_Y,		// seen from +y like DISPLAY_MODE_ORTHOGONAL_Y
+	SLICE_AXIS_Z,		// seen from +z like DISPLAY_MODE_ORTHOGONAL_Z
+	SLICE_AXIS_OBLIQUE,	// any plane, given by its normal
+};
+
+struct SliceRequest {
+	SliceAxis axis = SLICE_AXIS_Z;
+	// 0 and 1 are the first and last positions where the plane still cuts the volume
+	float position = 0.5f;
+	// Oblique slices only: the plane normal in texture space and the image size.
+	// Axis-aligned slices always use the voxel resolution.
+	glm::vec3 normal = glm::vec3(0.0f, 0.0f, 1.0f);
+	int width = 512;
+	int height = 512;
+
+	bool operator==(const SliceRequest& other) const {
+		return axis == other.axis && position == other.position && normal == other.normal && width == other.width && height == other.height;
+	}
+	bool operator!=(const SliceRequest& other) const { return !(*this == other); }
+};
+
+struct SliceImage {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;	// RGBA8, bottom row first like the CPU renderers
+};
+
+// Multiplanar reformatting on the CPU, straight from the samples of the .raw file.
+// Resampled samples are cached per slice position at the width of the file (8 or 16 bits), so scrubbing back and forth
+// or changing the transfer function only pays for the colormap lookup. Nothing here touches OpenGL or the engine,
+// the images can be produced without a window.
+class SliceRenderer {
+public:
+	struct Stats {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t cached_bytes = 0;
+	};
+
+	explicit SliceRenderer(TaskScheduler& scheduler, size_t cache_bytes = 256 << 20) : scheduler(scheduler), cache_budget(cache_bytes) {}
+
+	// Resample the slice (or take it from the cache) and apply the transfer function, blending it over background.
+	std::shared_ptr<SliceImage> Render(const RawVolume& volume, const std::vector<float>& colormap, const SliceRequest& request, const glm::vec3& background);
+	void ClearCache();
+
+	// World size of the image for a volume of volume_size, to keep the aspect ratio on screen.
+	static glm::vec2 GetWorldSize(const SliceRequest& request, const glm::vec3& volume_size);
+
+	const Stats& GetStats() const { return stats; }
+	float GetLastRenderTime() const { return last_render_time; }
+
+	static const char* GetAxisName(SliceAxis axis);
+
+private:
+	// Quantized request, the values of two requests with the same key are identical
+	struct Key {
+		size_t volume_version;
+		int axis;
+		int position;
+		glm::ivec3 normal;
+		int width;
+		int height;
+
+		bool operator==(const Key& other) const {
+			return volume_version == other.volume_version && axis == other.axis && position == other.position
+				&& normal == other.normal && width == other.width && height == other.height;
+		}
+	};
+
+	// Samples as stored in the RawVolume, only one of samples8 and samples16 is used.
+	// inside is empty for axis-aligned slices, pixels of an oblique slice which miss the volume have inside = 0.
+	struct Slice {
+		Key key;
+		int width;
+		int height;
+		std::vector<uint8_t> samples8;
+		std::vector<uint16_t> samples16;
+		std::vector<uint8_t> inside;
+
+		uint32_t GetSample(size_t index) const { return samples8.empty() ? samples16[index] : samples8[index]; }
+		size_t GetMemorySize() const { return samples8.size() + samples16.size() * sizeof(uint16_t) + inside.size(); }
+	};
+
+	Key MakeKey(const RawVolume& volume, const SliceRequest& request) const;
+	std::shared_ptr<const Slice> Resample(const RawVolume& volume, const SliceRequest& request, const Key& key);
+
+	TaskScheduler& scheduler;
+	size_t cache_budget;
+	// Most recently used first
+	std::list<std::shared_ptr<const Slice>> cache;
+	Stats stats;
+	float last_render_time = 0.0f;
+};
@@ -0,0 +1,219 @@
+#include "StreamingUploader.h"
+
+#include <algorithm>
+#include <cstring>
+
+StreamingUploader::StreamingUploader(size_t segment_size, int segment_count) : segment_size(segment_size), segment_count(std::clamp(segment_count, 2, 8)) {
+	const size_t ring_size = segment_size * this->segment_count;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+#ifdef GL_VERSION_4_4
+	if (GLAD_GL_VERSION_4_4) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ring_size, nullptr, flags);
+		mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ring_size, flags));
+		is_persistent = mapped != nullptr;
+	}
+#endif
+	if (!is_persistent) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, ring_size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+StreamingUploader::~StreamingUploader() {
+	for (GLsync& fence : fences) {
+		if (fence) {
+			glDeleteSync(fence);
+		}
+	}
+	if (is_persistent) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void StreamingUploader::QueueTexture2D(GLuint texture, int width, int height, GLenum format, GLenum type, size_t texel_bytes, const void* data, std::shared_ptr<const void> owner) {
+	const size_t row_bytes = width * texel_bytes;
+	Job job{ GL_TEXTURE_2D, texture, width, height, 1, format, type, row_bytes, height, row_bytes * height, 0, static_cast<const unsigned char*>(data), std::move(owner) };
+	stats.pending_bytes += job.total_bytes;
+	jobs.push_back(std::move(job));
+}
+
+void StreamingUploader::QueueTexture3D(GLuint texture, int width, int height, int depth, GLenum format, GLenum type, size_t texel_bytes, const void* data, std::shared_ptr<const void> owner) {
+	const size_t slice_bytes = static_cast<size_t>(width) * height * texel_bytes;
+	Job job{ GL_TEXTURE_3D, texture, width, height, depth, format, type, slice_bytes, depth, slice_bytes * depth, 0, static_cast<const unsigned char*>(data), std::move(owner) };
+	stats.pending_bytes += job.total_bytes;
+	jobs.push_back(std::move(job));
+}
+
+void StreamingUploader::QueueBuffer(GLuint buffer, size_t offset, size_t bytes, size_t block_bytes, const void* data, std::shared_ptr<const void> owner) {
+	if (bytes == 0) {
+		return;
+	}
+	block_bytes = std::clamp<size_t>(block_bytes, 1, bytes);
+	const int block_count = static_cast<int>((bytes + block_bytes - 1) / block_bytes);
+	Job job{ GL_ARRAY_BUFFER, buffer, 0, 0, 0, GL_NONE, GL_NONE, block_bytes, block_count, bytes, 0, static_cast<const unsigned char*>(data), std::move(owner) };
+	job.buffer_offset = offset;
+	stats.pending_bytes += job.total_bytes;
+	jobs.push_back(std::move(job));
+}
+
+void StreamingUploader::Cancel(GLuint texture) {
+	Cancel(texture, false);
+}
+
+void StreamingUploader::CancelBuffer(GLuint buffer) {
+	Cancel(buffer, true);
+}
+
+void StreamingUploader::Cancel(GLuint object, bool is_buffer) {
+	// Texture and buffer names are separate, the same number can be both
+	for (auto it = jobs.begin(); it != jobs.end();) {
+		if (it->object == object && (it->target == GL_ARRAY_BUFFER) == is_buffer) {
+			stats.pending_bytes -= it->total_bytes - GetRangeBytes(*it, 0, it->next_unit);
+			it = jobs.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+bool StreamingUploader::IsPending(GLuint texture) const {
+	return std::any_of(jobs.cbegin(), jobs.cend(), [texture](const Job& job) { return job.target != GL_ARRAY_BUFFER && job.object == texture; });
+}
+
+bool StreamingUploader::IsBufferPending(GLuint buffer) const {
+	return std::any_of(jobs.cbegin(), jobs.cend(), [buffer](const Job& job) { return job.target == GL_ARRAY_BUFFER && job.object == buffer; });
+}
+
+size_t StreamingUploader::GetUploadedBytes(GLuint buffer) const {
+	for (const Job& job : jobs) {
+		if (job.target == GL_ARRAY_BUFFER && job.object == buffer) {
+			return job.buffer_offset + GetRangeBytes(job, 0, job.next_unit);
+		}
+	}
+	return 0;
+}
+
+bool StreamingUploader::WaitForSegment() {
+	// 等 GPU 用完這個 segment 才能覆寫，還沒用完就等下一個 frame 再試，不要卡住 render thread
+	GLsync& fence = fences[current_segment];
+	if (!fence) {
+		return true;
+	}
+	const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		stats.stalls++;
+		return false;
+	}
+	if (status == GL_WAIT_FAILED) {
+		// The fence cannot tell, so make sure the GPU is done with everything before the segment is reused
+		glFinish();
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+	return true;
+}
+
+void StreamingUploader::Update() {
+	if (jobs.empty()) {
+		return;
+	}
+
+	if (!WaitForSegment()) {
+		return;
+	}
+
+	const size_t segment_offset = segment_size * current_segment;
+	unsigned char* segment = nullptr;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	if (is_persistent) {
+		segment = mapped + segment_offset;
+	} else {
+		segment = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, segment_offset, segment_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	}
+
+	// Copy as many whole units as fit into the segment
+	struct Pending { Job* job; int first; int count; size_t offset; };
+	Pending pending[16];
+	int pending_count = 0;
+	size_t used = 0;
+	for (Job& job : jobs) {
+		if (!segment || pending_count == 16 || used + job.unit_bytes > segment_size) {
+			break;
+		}
+		const int count = std::min(job.unit_count - job.next_unit, static_cast<int>((segment_size - used) / job.unit_bytes));
+		const size_t bytes = GetRangeBytes(job, job.next_unit, count);
+		std::memcpy(segment + used, job.data + job.unit_bytes * job.next_unit, bytes);
+		pending[pending_count++] = { &job, job.next_unit, count, used };
+		used += bytes;
+		if (job.next_unit + count < job.unit_count) {
+			break;
+		}
+	}
+
+	if (!is_persistent && segment) {
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < pending_count; i++) {
+		const size_t bytes = GetRangeBytes(*pending[i].job, pending[i].first, pending[i].count);
+		UploadUnits(*pending[i].job, pending[i].first, pending[i].count, reinterpret_cast<const void*>(segment_offset + pending[i].offset), true);
+		pending[i].job->next_unit += pending[i].count;
+		stats.uploaded_bytes += bytes;
+		stats.pending_bytes -= bytes;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// A unit that never fits into a segment goes straight from client memory
+	if (pending_count == 0) {
+		Job& job = jobs.front();
+		const size_t bytes = GetRangeBytes(job, job.next_unit, 1);
+		UploadUnits(job, job.next_unit, 1, job.data + job.unit_bytes * job.next_unit, false);
+		job.next_unit++;
+		stats.direct_uploads++;
+		stats.uploaded_bytes += bytes;
+		stats.pending_bytes -= bytes;
+	} else {
+		GLsync& fence = fences[current_segment];
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		current_segment = (current_segment + 1) % segment_count;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	while (!jobs.empty() && jobs.front().next_unit >= jobs.front().unit_count) {
+		jobs.pop_front();
+	}
+}
+
+void StreamingUploader::UploadUnits(const Job& job, int first, int count, const void* source, bool from_ring) {
+	if (job.target == GL_ARRAY_BUFFER) {
+		const size_t offset = job.buffer_offset + job.unit_bytes * first;
+		const size_t bytes = GetRangeBytes(job, first, count);
+		if (from_ring) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, job.object);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, reinterpret_cast<GLintptr>(source), offset, bytes);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		} else {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, job.object);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, source);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		return;
+	}
+
+	glBindTexture(job.target, job.object);
+	if (job.target == GL_TEXTURE_3D) {
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, first, job.width, job.height, count, job.format, job.type, source);
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, job.width, count, job.format, job.type, source);
+	}
+	glBindTexture(job.target, 0);
+}
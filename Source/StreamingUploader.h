@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+// Streams texture data a few slices (3D) or rows (2D) per frame, and buffer data a few blocks per frame, to the GPU
+// through a ring of pixel unpack buffers, so big uploads do not stall a single frame. The ring is persistently mapped
+// when GL 4.4 is available and falls back to unsynchronized glMapBufferRange otherwise. Every ring segment is guarded
+// by a fence and only rewritten once the GPU has signaled it.
+class StreamingUploader {
+public:
+	struct Stats {
+		size_t uploaded_bytes = 0;
+		size_t pending_bytes = 0;
+		size_t stalls = 0;			// frames which uploaded nothing because the GPU still used the next segment
+		size_t direct_uploads = 0;	// units bigger than a segment, uploaded straight from client memory
+	};
+
+	explicit StreamingUploader(size_t segment_size = 16 << 20, int segment_count = 3);
+	~StreamingUploader();
+
+	StreamingUploader(const StreamingUploader&) = delete;
+	StreamingUploader& operator=(const StreamingUploader&) = delete;
+
+	// The texture storage must already exist (glTexImage with nullptr). The data is read during later Update() calls,
+	// so it has to stay alive until the upload is done; pass owner to keep it alive automatically.
+	void QueueTexture2D(GLuint texture, int width, int height, GLenum format, GLenum type, size_t texel_bytes, const void* data, std::shared_ptr<const void> owner = nullptr);
+	void QueueTexture3D(GLuint texture, int width, int height, int depth, GLenum format, GLenum type, size_t texel_bytes, const void* data, std::shared_ptr<const void> owner = nullptr);
+	// The same for `bytes` of a buffer object starting at offset, uploaded in blocks of block_bytes.
+	// Ranges of the same buffer are uploaded in the order they were queued, see GetUploadedBytes().
+	void QueueBuffer(GLuint buffer, size_t offset, size_t bytes, size_t block_bytes, const void* data, std::shared_ptr<const void> owner = nullptr);
+
+	// Drop the queued uploads of a texture or a buffer, e.g. before its source data is overwritten.
+	void Cancel(GLuint texture);
+	void CancelBuffer(GLuint buffer);
+
+	// Upload up to one ring segment. Call once per frame with the GL context current.
+	void Update();
+
+	bool IsIdle() const { return jobs.empty(); }
+	bool IsPending(GLuint texture) const;
+	bool IsBufferPending(GLuint buffer) const;
+	// Where the uploaded front of a pending buffer ends, if its ranges were queued front to back. 0 if nothing is pending.
+	size_t GetUploadedBytes(GLuint buffer) const;
+	bool IsPersistent() const { return is_persistent; }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct Job {
+		GLenum target;			// GL_TEXTURE_2D, GL_TEXTURE_3D or GL_ARRAY_BUFFER
+		GLuint object;
+		int width, height, depth;
+		GLenum format, type;
+		size_t unit_bytes;		// one slice for 3D, one row for 2D, one block for buffers
+		int unit_count;
+		size_t total_bytes;		// the last block of a buffer may be shorter
+		int next_unit = 0;
+		const unsigned char* data;
+		std::shared_ptr<const void> owner;
+		size_t buffer_offset = 0;	// where unit 0 of a buffer goes
+	};
+
+	static size_t GetRangeBytes(const Job& job, int first, int count) {
+		return std::min(job.total_bytes, job.unit_bytes * (first + count)) - job.unit_bytes * first;
+	}
+	bool WaitForSegment();
+	void Cancel(GLuint object, bool is_buffer);
+	// source is an offset into the ring when from_ring is set, client memory otherwise
+	void UploadUnits(const Job& job, int first, int count, const void* source, bool from_ring);
+
+	GLuint buffer = 0;
+	unsigned char* mapped = nullptr;
+	bool is_persistent = false;
+	size_t segment_size;
+	int segment_count;
+	int current_segment = 0;
+	GLsync fences[8] = {};
+
+	std::deque<Job> jobs;
+	Stats stats;
+};
@@ -0,0 +1,118 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+TaskScheduler::TaskScheduler(unsigned int thread_count) {
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (unsigned int i = 0; i < thread_count; i++) {
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+	for (unsigned int i = 1; i < thread_count; i++) {
+		workers.emplace_back(&TaskScheduler::WorkerLoop, this, i);
+	}
+}
+
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		is_stopping = true;
+	}
+	wake_condition.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void TaskScheduler::ParallelFor(size_t count, const std::function<void(size_t)>& func) {
+	if (count == 0) {
+		return;
+	}
+
+	// Only one job runs at a time; other callers wait here.
+	std::lock_guard<std::mutex> job_lock(job_mutex);
+
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		job = &func;
+		remaining = count;
+	}
+
+	// Hand out contiguous ranges so neighbouring tiles start on the same thread.
+	const size_t queue_count = queues.size();
+	for (size_t q = 0; q < queue_count; q++) {
+		const size_t begin = count * q / queue_count;
+		const size_t end = count * (q + 1) / queue_count;
+		std::lock_guard<std::mutex> lock(queues[q]->mutex);
+		for (size_t i = begin; i < end; i++) {
+			queues[q]->tasks.push_back(i);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		job_generation++;
+	}
+	wake_condition.notify_all();
+
+	RunTasks(0);
+
+	std::unique_lock<std::mutex> lock(state_mutex);
+	done_condition.wait(lock, [this]() { return remaining.load() == 0; });
+	job = nullptr;
+}
+
+void TaskScheduler::WorkerLoop(unsigned int index) {
+	size_t seen_generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(state_mutex);
+			wake_condition.wait(lock, [&]() { return is_stopping || job_generation != seen_generation; });
+			if (is_stopping) {
+				return;
+			}
+			seen_generation = job_generation;
+		}
+		RunTasks(index);
+	}
+}
+
+void TaskScheduler::RunTasks(unsigned int index) {
+	size_t task;
+	while (PopTask(index, task)) {
+		(*job)(task);
+		if (remaining.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> lock(state_mutex);
+			done_condition.notify_all();
+		}
+	}
+}
+
+bool TaskScheduler::PopTask(unsigned int index, size_t& task) {
+	// 先處理自己的工作（從尾端拿）
+	{
+		WorkQueue& own = *queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// 自己的做完了就去偷別人的（從前端拿）
+	const unsigned int queue_count = static_cast<unsigned int>(queues.size());
+	for (unsigned int offset = 1; offset < queue_count; offset++) {
+		WorkQueue& victim = *queues[(index + offset) % queue_count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			steal_count++;
+			return true;
+		}
+	}
+	return false;
+}
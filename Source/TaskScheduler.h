@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool for the CPU renderers.
+// Every worker owns a queue; idle workers steal from the front of the others' queues.
+class TaskScheduler {
+public:
+	explicit TaskScheduler(unsigned int thread_count = 0);
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	// Run func(i) for every i in [0, count) and block until all tasks are done.
+	// The calling thread works on the tasks as well.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	unsigned int GetThreadCount() const { return static_cast<unsigned int>(queues.size()); }
+	size_t GetStealCount() const { return steal_count.load(); }
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	void WorkerLoop(unsigned int index);
+	void RunTasks(unsigned int index);
+	bool PopTask(unsigned int index, size_t& task);
+
+	// queues[0] belongs to the thread calling ParallelFor, queues[i] to workers[i - 1].
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex job_mutex;
+	std::mutex state_mutex;
+	std::condition_variable wake_condition;
+	std::condition_variable done_condition;
+	const std::function<void(size_t)>* job = nullptr;
+	size_t job_generation = 0;
+	bool is_stopping = false;
+
+	std::atomic<size_t> remaining{ 0 };
+	std::atomic<size_t> steal_count{ 0 };
+};
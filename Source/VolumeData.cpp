@@ -0,0 +1,282 @@
+#include "VolumeData.h"
+
+#include "Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+namespace {
+	size_t NextVersion() {
+		static std::atomic<size_t> next_version{ 1 };
+		return next_version++;
+	}
+}
+
+bool VolumeData::LoadFromTexture(GLuint texture, VolumeLayout new_layout) {
+	if (texture == 0) {
+		return false;
+	}
+
+	GLint width = 0, height = 0, depth = 0;
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_3D, 0, GL_TEXTURE_DEPTH, &depth);
+	if (width <= 0 || height <= 0 || depth <= 0) {
+		glBindTexture(GL_TEXTURE_3D, 0);
+		return false;
+	}
+
+	// The offset tables and the packet gathers index the floats with int32
+	if (VoxelLayout::GetStorageVoxels(glm::ivec3(width, height, depth), VOLUME_LAYOUT_LINEAR) > kMaxStorageVoxels) {
+		glBindTexture(GL_TEXTURE_3D, 0);
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "The volume is too large for the CPU copy (" + std::to_string(width) + "x"
+			+ std::to_string(height) + "x" + std::to_string(depth) + ").");
+		return false;
+	}
+
+	version = NextVersion();
+	resolution = glm::ivec3(width, height, depth);
+	voxel_layout.Build(resolution, VOLUME_LAYOUT_LINEAR, kMaxStorageVoxels);
+	voxels.resize(voxel_layout.GetStorageVoxels());
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_FLOAT, voxels.data());
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	SetLayout(new_layout);
+	return true;
+}
+
+bool VolumeData::LoadFromRawVolume(const RawVolume& raw, float max_gradient, VolumeLayout new_layout) {
+	const glm::ivec3& raw_resolution = raw.GetResolution();
+	if (VoxelLayout::GetStorageVoxels(raw_resolution, VOLUME_LAYOUT_LINEAR) > kMaxStorageVoxels) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "The volume is too large for the CPU copy (" + std::to_string(raw_resolution.x) + "x"
+			+ std::to_string(raw_resolution.y) + "x" + std::to_string(raw_resolution.z) + ").");
+		return false;
+	}
+
+	version = NextVersion();
+	resolution = raw_resolution;
+	voxel_layout.Build(resolution, VOLUME_LAYOUT_LINEAR, kMaxStorageVoxels);
+	voxels = raw.BuildTexels(max_gradient);
+
+	SetLayout(new_layout);
+	return true;
+}
+
+void VolumeData::Clear() {
+	resolution = glm::ivec3(0);
+	voxels.clear();
+	voxels.shrink_to_fit();
+	voxel_layout = VoxelLayout();
+}
+
+void VolumeData::SetLayout(VolumeLayout new_layout) {
+	if (IsEmpty()) {
+		return;
+	}
+	if (VoxelLayout::GetStorageVoxels(resolution, new_layout) > kMaxStorageVoxels) {
+		Nexus::Logger::Message(Nexus::LOG_WARNING, std::string(VoxelLayout::GetLayoutName(new_layout)) + " padding does not fit the 32-bit voxel offsets, keeping the linear layout.");
+	}
+	const VoxelLayout old_layout = voxel_layout;
+	voxel_layout.Build(resolution, new_layout, kMaxStorageVoxels);
+	if (voxel_layout.GetLayout() == old_layout.GetLayout()) {
+		return;
+	}
+
+	const std::vector<glm::vec4> old_voxels = std::move(voxels);
+	voxels.assign(voxel_layout.GetStorageVoxels(), glm::vec4(0.0f));
+	for (int z = 0; z < resolution.z; z++) {
+		for (int y = 0; y < resolution.y; y++) {
+			for (int x = 0; x < resolution.x; x++) {
+				voxels[Index(x, y, z)] = old_voxels[old_layout.Index(x, y, z)];
+			}
+		}
+	}
+}
+
+glm::vec4 VolumeData::Fetch(int x, int y, int z) const {
+	x = std::clamp(x, 0, resolution.x - 1);
+	y = std::clamp(y, 0, resolution.y - 1);
+	z = std::clamp(z, 0, resolution.z - 1);
+	return voxels[Index(x, y, z)];
+}
+
+glm::vec4 VolumeData::Sample(const glm::vec3& tex_coord) const {
+	// Texel centers are at (i + 0.5) / N, same as OpenGL.
+	const float px = tex_coord.x * resolution.x - 0.5f;
+	const float py = tex_coord.y * resolution.y - 0.5f;
+	const float pz = tex_coord.z * resolution.z - 0.5f;
+	const int x0 = static_cast<int>(std::floor(px));
+	const int y0 = static_cast<int>(std::floor(py));
+	const int z0 = static_cast<int>(std::floor(pz));
+	const float fx = px - x0;
+	const float fy = py - y0;
+	const float fz = pz - z0;
+
+	const glm::vec4 c00 = glm::mix(Fetch(x0, y0, z0), Fetch(x0 + 1, y0, z0), fx);
+	const glm::vec4 c10 = glm::mix(Fetch(x0, y0 + 1, z0), Fetch(x0 + 1, y0 + 1, z0), fx);
+	const glm::vec4 c01 = glm::mix(Fetch(x0, y0, z0 + 1), Fetch(x0 + 1, y0, z0 + 1), fx);
+	const glm::vec4 c11 = glm::mix(Fetch(x0, y0 + 1, z0 + 1), Fetch(x0 + 1, y0 + 1, z0 + 1), fx);
+	return glm::mix(glm::mix(c00, c10, fy), glm::mix(c01, c11, fy), fz);
+}
+
+float VolumeData::SampleValue(const glm::vec3& tex_coord) const {
+	const float px = tex_coord.x * resolution.x - 0.5f;
+	const float py = tex_coord.y * resolution.y - 0.5f;
+	const float pz = tex_coord.z * resolution.z - 0.5f;
+	const int x0 = static_cast<int>(std::floor(px));
+	const int y0 = static_cast<int>(std::floor(py));
+	const int z0 = static_cast<int>(std::floor(pz));
+	const float fx = px - x0;
+	const float fy = py - y0;
+	const float fz = pz - z0;
+
+	const float c00 = glm::mix(Fetch(x0, y0, z0).w, Fetch(x0 + 1, y0, z0).w, fx);
+	const float c10 = glm::mix(Fetch(x0, y0 + 1, z0).w, Fetch(x0 + 1, y0 + 1, z0).w, fx);
+	const float c01 = glm::mix(Fetch(x0, y0, z0 + 1).w, Fetch(x0 + 1, y0, z0 + 1).w, fx);
+	const float c11 = glm::mix(Fetch(x0, y0 + 1, z0 + 1).w, Fetch(x0 + 1, y0 + 1, z0 + 1).w, fx);
+	return glm::mix(glm::mix(c00, c10, fy), glm::mix(c01, c11, fy), fz);
+}
+
+namespace {
+	// Cache-miss proxy for BenchmarkLayouts(): a 32 KB, 8-way set associative cache of 64-byte lines with LRU
+	// replacement, roughly an L1 data cache. Timings alone depend on the prefetchers and the other caches of the machine.
+	class CacheModel {
+	public:
+		static constexpr size_t kLineBytes = 64;
+		static constexpr size_t kWays = 8;
+		static constexpr size_t kSets = 32 * 1024 / kLineBytes / kWays;
+
+		CacheModel() : tags(kSets * kWays, SIZE_MAX) {}
+
+		void Access(const void* address) {
+			const size_t line = reinterpret_cast<uintptr_t>(address) / kLineBytes;
+			size_t* set = &tags[(line % kSets) * kWays];
+			accesses++;
+			// Most recently used first
+			for (size_t way = 0; way < kWays; way++) {
+				if (set[way] == line) {
+					std::rotate(set, set + way, set + way + 1);
+					return;
+				}
+			}
+			misses++;
+			std::rotate(set, set + kWays - 1, set + kWays);
+			set[0] = line;
+		}
+		double GetMissesPerThousand() const { return accesses > 0 ? 1000.0 * misses / accesses : 0.0; }
+
+	private:
+		std::vector<size_t> tags;
+		size_t accesses = 0;
+		size_t misses = 0;
+	};
+
+	const size_t kPageBytes = 4096;
+}
+
+void VolumeData::BenchmarkLayouts() const {
+	if (IsEmpty()) {
+		return;
+	}
+
+	// Same random oblique rays for every layout
+	std::mt19937 random(2021);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	const int ray_count = 4096;
+	const int ray_steps = 256;
+	std::vector<glm::vec3> ray_origins, ray_steps_delta;
+	for (int i = 0; i < ray_count; i++) {
+		const glm::vec3 from(distribution(random), distribution(random), distribution(random));
+		const glm::vec3 to(distribution(random), distribution(random), distribution(random));
+		ray_origins.push_back(from);
+		ray_steps_delta.push_back((to - from) / static_cast<float>(ray_steps));
+	}
+
+	Nexus::Logger::Message(Nexus::LOG_INFO, "Volume layout benchmark (MSamples/s, higher is better; "
+		"L1 misses per 1000 fetches of a modelled 32 KB 8-way cache and 4 KB pages per oblique ray, lower is better):");
+	for (VolumeLayout candidate : { VOLUME_LAYOUT_LINEAR, VOLUME_LAYOUT_MORTON, VOLUME_LAYOUT_BRICKED }) {
+		VolumeData copy = *this;
+		copy.SetLayout(candidate);
+
+		// Walk the whole volume with the innermost loop along the given axis
+		auto walk_axis = [&copy](int axis, CacheModel* cache) {
+			const int inner = axis, middle = (axis + 1) % 3, outer = (axis + 2) % 3;
+			const glm::ivec3& res = copy.resolution;
+			float sum = 0.0f;
+			glm::ivec3 p;
+			for (p[outer] = 0; p[outer] < res[outer]; p[outer]++) {
+				for (p[middle] = 0; p[middle] < res[middle]; p[middle]++) {
+					for (p[inner] = 0; p[inner] < res[inner]; p[inner]++) {
+						const glm::vec4& voxel = copy.voxels[copy.Index(p.x, p.y, p.z)];
+						if (cache) {
+							cache->Access(&voxel);
+						}
+						sum += voxel.w;
+					}
+				}
+			}
+			return sum;
+		};
+
+		std::string line = std::string(VoxelLayout::GetLayoutName(copy.GetLayout())) + " (" + std::to_string(copy.GetStorageSize() >> 20) + " MB):";
+		const double voxel_count = static_cast<double>(resolution.x) * resolution.y * resolution.z;
+		volatile float sink = 0.0f;
+		const char* axis_names[3] = { " x ", " y ", " z " };
+		for (int axis = 0; axis < 3; axis++) {
+			const auto start = std::chrono::high_resolution_clock::now();
+			sink = sink + walk_axis(axis, nullptr);
+			const auto end = std::chrono::high_resolution_clock::now();
+			const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+			// Counted in a second pass so the model does not slow down the timed one
+			CacheModel cache;
+			sink = sink + walk_axis(axis, &cache);
+			line += std::string(axis_names[axis]) + std::to_string(voxel_count / (ms * 1000.0)) + " (" + std::to_string(cache.GetMissesPerThousand()) + " miss/k)";
+		}
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		float sum = 0.0f;
+		for (int i = 0; i < ray_count; i++) {
+			glm::vec3 position = ray_origins[i];
+			for (int step = 0; step < ray_steps; step++) {
+				sum += copy.SampleValue(position);
+				position += ray_steps_delta[i];
+			}
+		}
+		sink = sink + sum;
+		const auto end = std::chrono::high_resolution_clock::now();
+		const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+		// The 8 corners of every trilinear sample, the same fetches SampleValue() makes
+		CacheModel cache;
+		double pages_per_ray = 0.0;
+		std::vector<size_t> pages;
+		for (int i = 0; i < ray_count; i++) {
+			pages.clear();
+			glm::vec3 position = ray_origins[i];
+			for (int step = 0; step < ray_steps; step++) {
+				const glm::vec3 p = position * glm::vec3(resolution) - glm::vec3(0.5f);
+				const glm::ivec3 base = glm::ivec3(glm::floor(p));
+				for (int corner = 0; corner < 8; corner++) {
+					const glm::ivec3 c = glm::clamp(base + glm::ivec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1), glm::ivec3(0), resolution - 1);
+					const glm::vec4* voxel = &copy.voxels[copy.Index(c.x, c.y, c.z)];
+					cache.Access(voxel);
+					pages.push_back(reinterpret_cast<uintptr_t>(voxel) / kPageBytes);
+				}
+				position += ray_steps_delta[i];
+			}
+			std::sort(pages.begin(), pages.end());
+			pages_per_ray += static_cast<double>(std::unique(pages.begin(), pages.end()) - pages.begin());
+		}
+		line += " oblique " + std::to_string(static_cast<double>(ray_count) * ray_steps / (ms * 1000.0)) + " (" + std::to_string(cache.GetMissesPerThousand())
+			+ " miss/k, " + std::to_string(pages_per_ray / ray_count) + " pages/ray)";
+
+		Nexus::Logger::Message(Nexus::LOG_INFO, line);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "RawVolume.h"
+#include "VoxelLayout.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// CPU-side copy of the engine's volume texture.
+// Each voxel keeps the gradient in rgb and the normalized scalar value in a, same as ray_casting.frag sees it.
+// The voxel at (x, y, z) lives at GetRawData()[(offset_x[x] + offset_y[y] + offset_z[z]) * 4], see VoxelLayout.
+// That float index always fits in int32 (the packet kernels gather with it): volumes which would not fit are rejected
+// and layouts whose padding would not fit fall back to the linear one.
+class VolumeData {
+public:
+	static constexpr size_t kMaxStorageVoxels = static_cast<size_t>(INT32_MAX) / 4;
+
+	VolumeData() = default;
+
+	// Read back the 3D texture from the GPU. Returns false if the texture is not ready yet.
+	bool LoadFromTexture(GLuint texture, VolumeLayout layout = VOLUME_LAYOUT_LINEAR);
+	// Build the same voxels from the samples of a .raw file, with RawVolume::FetchGradient() as the gradient.
+	// Needs no GL context, so it can run in a background thread. Returns false if the volume is too large.
+	bool LoadFromRawVolume(const RawVolume& raw, float max_gradient, VolumeLayout layout = VOLUME_LAYOUT_LINEAR);
+	void Clear();
+
+	// Reorder the voxels in place. Falls back to VOLUME_LAYOUT_LINEAR if the padded storage would be too large.
+	void SetLayout(VolumeLayout new_layout);
+	VolumeLayout GetLayout() const { return voxel_layout.GetLayout(); }
+
+	// Texel fetch with clamp-to-edge.
+	glm::vec4 Fetch(int x, int y, int z) const;
+	// Trilinear sample, tex_coord is in [0, 1] like texture() in GLSL.
+	glm::vec4 Sample(const glm::vec3& tex_coord) const;
+	float SampleValue(const glm::vec3& tex_coord) const;
+
+	bool IsEmpty() const { return voxels.empty(); }
+	// Changes every time new data is loaded, so caches built from the volume can tell it apart.
+	size_t GetVersion() const { return version; }
+	const glm::ivec3& GetResolution() const { return resolution; }
+	const float* GetRawData() const { return &voxels.data()->x; }
+	const int32_t* GetOffsetsX() const { return voxel_layout.GetOffsetsX(); }
+	const int32_t* GetOffsetsY() const { return voxel_layout.GetOffsetsY(); }
+	const int32_t* GetOffsetsZ() const { return voxel_layout.GetOffsetsZ(); }
+	size_t GetStorageSize() const { return voxels.size() * sizeof(glm::vec4); }
+
+	// Log the fetch throughput of every layout for axis-aligned walks and oblique rays, with the misses of a modelled
+	// 32 KB 8-way L1 cache and the 4 KB pages an oblique ray touches as the cache-miss proxy.
+	void BenchmarkLayouts() const;
+
+private:
+	size_t Index(int x, int y, int z) const { return voxel_layout.Index(x, y, z); }
+
+	glm::ivec3 resolution = glm::ivec3(0);
+	size_t version = 0;
+	std::vector<glm::vec4> voxels;
+	VoxelLayout voxel_layout;
+};
@@ -0,0 +1,313 @@
+#include "VolumeSequence.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	std::string StripExtension(const std::string& file_name) {
+		const size_t dot = file_name.find_last_of('.');
+		return dot == std::string::npos ? file_name : file_name.substr(0, dot);
+	}
+}
+
+VolumeSequence::VolumeSequence(unsigned int decode_threads) {
+	for (unsigned int i = 0; i < std::max(1u, decode_threads); i++) {
+		workers.emplace_back(&VolumeSequence::DecodeLoop, this);
+	}
+}
+
+VolumeSequence::~VolumeSequence() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		is_stopping = true;
+	}
+	condition.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	glDeleteTextures(2, textures);
+}
+
+bool VolumeSequence::Open(const std::string& folder, std::vector<std::string> raw_files, const std::vector<std::string>& inf_files, float max_gradient) {
+	Close();
+	if (raw_files.empty() || inf_files.empty()) {
+		return false;
+	}
+	std::sort(raw_files.begin(), raw_files.end());
+
+	// Every timestep must share the resolution of the first one, it is drawn with the same proxy geometry
+	std::vector<std::string> paths;
+	std::vector<std::string> skipped;
+	VolumeInfo first_info;
+	for (const std::string& raw_file : raw_files) {
+		std::string inf_file = inf_files.front();
+		for (const std::string& candidate : inf_files) {
+			if (StripExtension(candidate) == StripExtension(raw_file)) {
+				inf_file = candidate;
+			}
+		}
+
+		VolumeInfo timestep_info;
+		if (!VolumeInfo::Load(folder + "/" + inf_file, timestep_info)) {
+			Nexus::Logger::Message(Nexus::LOG_WARNING, "Sequence: cannot read " + inf_file + ", skip " + raw_file);
+			skipped.push_back(raw_file + " (no .inf)");
+			continue;
+		}
+		if (paths.empty()) {
+			first_info = timestep_info;
+		} else if (timestep_info.resolution != first_info.resolution || timestep_info.sample_type != first_info.sample_type) {
+			Nexus::Logger::Message(Nexus::LOG_WARNING, "Sequence: " + raw_file + " does not match the first timestep, skip it.");
+			skipped.push_back(raw_file + " (resolution or type differs)");
+			continue;
+		}
+		paths.push_back(folder + "/" + raw_file);
+	}
+	skipped_files = std::move(skipped);
+	if (paths.empty()) {
+		return false;
+	}
+
+	// Without a range in the .inf, take it from the first timestep so every timestep is normalized the same way
+	if (!first_info.has_value_range && first_info.sample_type != "unsigned char") {
+		std::shared_ptr<RawVolume> first = RawVolume::Load(paths.front(), first_info);
+		if (!first) {
+			return false;
+		}
+		first_info.value_range = first->GetValueRange();
+		first_info.has_value_range = true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		raw_paths = std::move(paths);
+		info = first_info;
+		this->max_gradient = max_gradient;
+		// The texels and the samples they were made from, floats are kept as 16-bit samples
+		const size_t sample_bytes = std::min<size_t>(info.GetSampleBytes(), 2);
+		frame_bytes = static_cast<size_t>(info.resolution.x) * info.resolution.y * info.resolution.z * (sizeof(glm::vec4) + sample_bytes);
+	}
+	CreateTextures();
+	SchedulePrefetch(0);
+
+	Nexus::Logger::Message(Nexus::LOG_INFO, "Sequence: " + std::to_string(raw_paths.size()) + " timesteps.");
+	return true;
+}
+
+void VolumeSequence::Close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.clear();
+		buffer.clear();
+		in_flight.clear();
+		raw_paths.clear();
+		window_from = 0;
+		generation++;
+	}
+	displayed_timestep = -1;
+	uploading_timestep = -1;
+	displayed_raw = nullptr;
+	uploading_raw = nullptr;
+	last_target = -1;
+	is_continuous = false;
+	clock = 0.0f;
+	stats = Stats();
+}
+
+void VolumeSequence::SetPrefetchCount(int count) {
+	std::lock_guard<std::mutex> lock(mutex);
+	prefetch_count = std::max(1, count);
+}
+
+void VolumeSequence::SetBufferBudget(size_t bytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	buffer_budget = bytes;
+}
+
+void VolumeSequence::SetLayout(VolumeLayout new_layout) {
+	std::lock_guard<std::mutex> lock(mutex);
+	layout = new_layout;
+}
+
+int VolumeSequence::GetPrefetchWindow() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return GetWindowLocked();
+}
+
+int VolumeSequence::GetWindowLocked() const {
+	// The current timestep is always kept, the budget decides how many more fit
+	const size_t fitting = frame_bytes > 0 ? buffer_budget / frame_bytes : 0;
+	return static_cast<int>(std::min<size_t>(prefetch_count, fitting > 0 ? fitting - 1 : 0));
+}
+
+bool VolumeSequence::IsInWindowLocked(int timestep) const {
+	const int frame_count = static_cast<int>(raw_paths.size());
+	return frame_count > 0 && (timestep - window_from + frame_count) % frame_count <= GetWindowLocked();
+}
+
+void VolumeSequence::Seek(int timestep) {
+	if (!IsOpen()) {
+		return;
+	}
+	clock = static_cast<float>(std::clamp(timestep, 0, GetFrameCount() - 1)) / frame_rate;
+	is_continuous = false;
+}
+
+size_t VolumeSequence::GetBufferedCount() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return buffer.size();
+}
+
+void VolumeSequence::CreateTextures() {
+	if (textures[0] == 0) {
+		glGenTextures(2, textures);
+	}
+	for (GLuint texture : textures) {
+		glBindTexture(GL_TEXTURE_3D, texture);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, info.resolution.x, info.resolution.y, info.resolution.z, 0, GL_RGBA, GL_FLOAT, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void VolumeSequence::Update(float delta_time, StreamingUploader& uploader) {
+	if (!IsOpen()) {
+		return;
+	}
+
+	const int frame_count = GetFrameCount();
+	if (is_playing) {
+		clock += delta_time;
+		if (frame_rate > 0.0f) {
+			clock = std::fmod(clock, static_cast<float>(frame_count) / frame_rate);
+		}
+	} else {
+		is_continuous = false;
+	}
+	const int target = static_cast<int>(clock * frame_rate) % frame_count;
+
+	// The back texture is complete, show it
+	if (uploading_timestep >= 0 && !uploader.IsPending(textures[1 - front])) {
+		front = 1 - front;
+		// Only timesteps the playback clock ran past count as dropped, not seeks, steps while paused or the first frame.
+		// Moving forward across the end of the sequence is normal playback, so the distance wraps around.
+		if (displayed_timestep >= 0 && is_continuous) {
+			stats.dropped_frames += (uploading_timestep - displayed_timestep - 1 + frame_count) % frame_count;
+		}
+		displayed_timestep = uploading_timestep;
+		displayed_raw = uploading_raw;
+		uploading_timestep = -1;
+		uploading_raw = nullptr;
+		is_continuous = is_playing;
+		stats.displayed_frames++;
+	}
+
+	if (uploading_timestep >= 0 || target == displayed_timestep) {
+		return;
+	}
+
+	std::shared_ptr<const Frame> frame;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = buffer.find(target);
+		if (it != buffer.end()) {
+			frame = it->second;
+		}
+	}
+
+	// Count every timestep once, not every frame it is waited for
+	if (target != last_target) {
+		last_target = target;
+		if (frame) {
+			stats.prefetch_hits++;
+		} else {
+			stats.prefetch_misses++;
+		}
+		SchedulePrefetch(target);
+	}
+
+	if (frame) {
+		uploading_timestep = target;
+		uploading_raw = frame->raw;
+		uploader.QueueTexture3D(textures[1 - front], info.resolution.x, info.resolution.y, info.resolution.z, GL_RGBA, GL_FLOAT, sizeof(glm::vec4), frame->texels.data(), frame);
+	}
+}
+
+void VolumeSequence::SchedulePrefetch(int from) {
+	const int frame_count = GetFrameCount();
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Keep [from, from + window] (wrapping around), drop everything else
+	const int window = GetWindowLocked();
+	window_from = from;
+	for (auto it = buffer.begin(); it != buffer.end();) {
+		it = IsInWindowLocked(it->first) ? std::next(it) : buffer.erase(it);
+	}
+
+	queue.clear();
+	for (int i = std::min(window, frame_count - 1); i >= 0; i--) {
+		const int timestep = (from + i) % frame_count;
+		if (buffer.count(timestep) == 0 && in_flight.count(timestep) == 0) {
+			queue.push_back(timestep);	// popped from the back, so the nearest timestep goes first
+		}
+	}
+	condition.notify_all();
+}
+
+void VolumeSequence::DecodeLoop() {
+	while (true) {
+		int timestep;
+		size_t job_generation;
+		std::string path;
+		VolumeInfo timestep_info;
+		float gradient_limit;
+		VolumeLayout timestep_layout;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return is_stopping || !queue.empty(); });
+			if (is_stopping) {
+				return;
+			}
+			timestep = queue.back();
+			queue.pop_back();
+			in_flight.insert(timestep);
+			job_generation = generation;
+			path = raw_paths[timestep];
+			timestep_info = info;
+			gradient_limit = max_gradient;
+			timestep_layout = layout;
+		}
+
+		std::shared_ptr<const Frame> frame = Decode(path, timestep_info, gradient_limit, timestep_layout);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		// The sequence may have been closed, or reopened, while decoding
+		if (job_generation != generation) {
+			continue;
+		}
+		in_flight.erase(timestep);
+		// Still wanted? Playback may have moved on or seeked away while decoding.
+		if (frame && IsInWindowLocked(timestep) && static_cast<int>(buffer.size()) <= GetWindowLocked()) {
+			buffer[timestep] = frame;
+		}
+	}
+}
+
+std::shared_ptr<const VolumeSequence::Frame> VolumeSequence::Decode(const std::string& path, const VolumeInfo& timestep_info, float gradient_limit, VolumeLayout layout) {
+	// Signed samples are decoded as signed and everything is normalized by the range in timestep_info
+	std::shared_ptr<const RawVolume> raw = RawVolume::Load(path, timestep_info, layout);
+	if (!raw) {
+		Nexus::Logger::Message(Nexus::LOG_ERROR, "Sequence: cannot read " + path);
+		return nullptr;
+	}
+
+	// Same gradients as the engine's volume texture
+	auto frame = std::make_shared<Frame>();
+	frame->texels = raw->BuildTexels(gradient_limit);
+	frame->raw = raw;
+	return frame;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "RawVolume.h"
+#include "StreamingUploader.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Plays a folder of .raw files as a time series.
+// Background threads decode the next timesteps into a buffer bounded by both a frame count and a byte budget,
+// and the volume texture is swapped at the target playback rate. The texture has the same layout as the engine's
+// (gradient in rgb, value in a). Every timestep is normalized by the same value range, see RawVolume.
+class VolumeSequence {
+public:
+	struct Stats {
+		size_t displayed_frames = 0;
+		size_t dropped_frames = 0;	// timesteps skipped during normal playback because they were not ready in time
+		size_t prefetch_hits = 0;
+		size_t prefetch_misses = 0;
+	};
+
+	explicit VolumeSequence(unsigned int decode_threads = 2);
+	~VolumeSequence();
+
+	VolumeSequence(const VolumeSequence&) = delete;
+	VolumeSequence& operator=(const VolumeSequence&) = delete;
+
+	// raw_files are played in alphabetical order. With a single .inf it is shared by all timesteps,
+	// otherwise each raw file uses the .inf with the same name. Files which do not match the first timestep are left out,
+	// see GetSkippedFiles().
+	bool Open(const std::string& folder, std::vector<std::string> raw_files, const std::vector<std::string>& inf_files, float max_gradient);
+	void Close();
+
+	// Advance the playback clock and swap the texture when the next timestep is on the GPU. Call once per frame.
+	void Update(float delta_time, StreamingUploader& uploader);
+
+	void SetPlaying(bool playing) { is_playing = playing; }
+	void SetFrameRate(float rate) { frame_rate = rate; }
+	void SetPrefetchCount(int count);
+	void SetBufferBudget(size_t bytes);
+	// Layout of the RawVolume of every timestep decoded from now on, already buffered ones keep theirs.
+	void SetLayout(VolumeLayout new_layout);
+	void Seek(int timestep);
+
+	bool IsOpen() const { return !raw_paths.empty(); }
+	bool IsPlaying() const { return is_playing; }
+	bool* PlayingHelper() { return &is_playing; }
+	float* FrameRateHelper() { return &frame_rate; }
+	int GetPrefetchCount() const { return prefetch_count; }
+	size_t GetBufferBudget() const { return buffer_budget; }
+	// Timesteps actually kept ahead, the prefetch count cut down to what fits into the byte budget.
+	int GetPrefetchWindow();
+	size_t GetFrameBytes() const { return frame_bytes; }
+	int GetFrameCount() const { return static_cast<int>(raw_paths.size()); }
+	int GetCurrentFrame() const { return displayed_timestep; }
+	size_t GetBufferedCount();
+	// 0 until the first timestep has been uploaded.
+	GLuint GetTexture() const { return displayed_timestep >= 0 ? textures[front] : 0; }
+	// Samples of the timestep in GetTexture(), for the CPU paths which read the file data directly
+	std::shared_ptr<const RawVolume> GetRawVolume() const { return displayed_raw; }
+	const VolumeInfo& GetInfo() const { return info; }
+	// Gradient threshold the texels were built with
+	float GetMaxGradient() const { return max_gradient; }
+	const std::vector<std::string>& GetSkippedFiles() const { return skipped_files; }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct Frame {
+		std::vector<glm::vec4> texels;
+		std::shared_ptr<const RawVolume> raw;
+	};
+
+	void DecodeLoop();
+	static std::shared_ptr<const Frame> Decode(const std::string& path, const VolumeInfo& timestep_info, float gradient_limit, VolumeLayout layout);
+	void SchedulePrefetch(int from);
+	int GetWindowLocked() const;
+	// Is the timestep within [window_from, window_from + window], wrapping around
+	bool IsInWindowLocked(int timestep) const;
+	void CreateTextures();
+
+	std::vector<std::string> raw_paths;
+	std::vector<std::string> skipped_files;
+	VolumeInfo info;
+	float max_gradient = 300.0f;
+	size_t frame_bytes = 0;
+
+	// Decoded timesteps, bounded by GetWindowLocked() + 1. raw_paths and info are only written under the mutex.
+	// Jobs of an older generation were started before the last Close() and must not touch buffer or in_flight.
+	std::mutex mutex;
+	size_t generation = 0;
+	int window_from = 0;
+	std::condition_variable condition;
+	std::map<int, std::shared_ptr<const Frame>> buffer;
+	std::set<int> in_flight;
+	std::vector<int> queue;
+	std::vector<std::thread> workers;
+	bool is_stopping = false;
+	int prefetch_count = 4;
+	VolumeLayout layout = VOLUME_LAYOUT_LINEAR;
+	size_t buffer_budget = static_cast<size_t>(1) << 30;
+
+	// Double-buffered texture, the back one is filled by the uploader
+	GLuint textures[2] = { 0, 0 };
+	int front = 0;
+	int displayed_timestep = -1;
+	int uploading_timestep = -1;
+	// Only the samples stay, the texels are released once they are on the GPU
+	std::shared_ptr<const RawVolume> displayed_raw;
+	std::shared_ptr<const RawVolume> uploading_raw;
+	int last_target = -1;
+	bool is_playing = false;
+	// False after a seek or a pause, the next swap is then not a candidate for dropped frames
+	bool is_continuous = false;
+	float frame_rate = 10.0f;
+	// Seconds into the sequence, wraps at its length so it never loses precision
+	float clock = 0.0f;
+	Stats stats;
+};
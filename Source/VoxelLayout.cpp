@@ -0,0 +1,110 @@
+#include "VoxelLayout.h"
+
+#include <algorithm>
+
+namespace {
+	// Bits per axis of the Morton code, an axis which runs out of bits stops taking part in the interleaving
+	// so a 256x256x128 volume does not get padded to 256^3.
+	glm::ivec3 GetMortonBits(const glm::ivec3& resolution) {
+		glm::ivec3 bits(0);
+		for (int axis = 0; axis < 3; axis++) {
+			while ((static_cast<int64_t>(1) << bits[axis]) < resolution[axis]) {
+				bits[axis]++;
+			}
+		}
+		return bits;
+	}
+
+	const int kBrickSize = 8;
+}
+
+size_t VoxelLayout::GetStorageVoxels(const glm::ivec3& resolution, VolumeLayout layout) {
+	switch (layout) {
+		case VOLUME_LAYOUT_MORTON: {
+			const glm::ivec3 bits = GetMortonBits(resolution);
+			return static_cast<size_t>(1) << (bits.x + bits.y + bits.z);
+		}
+		case VOLUME_LAYOUT_BRICKED: {
+			const glm::ivec3 bricks = (resolution + glm::ivec3(kBrickSize - 1)) / kBrickSize;
+			return static_cast<size_t>(bricks.x) * bricks.y * bricks.z * kBrickSize * kBrickSize * kBrickSize;
+		}
+		case VOLUME_LAYOUT_LINEAR:
+		default:
+			return static_cast<size_t>(resolution.x) * resolution.y * resolution.z;
+	}
+}
+
+void VoxelLayout::Build(const glm::ivec3& resolution, VolumeLayout new_layout, size_t max_storage_voxels) {
+	layout = GetStorageVoxels(resolution, new_layout) > max_storage_voxels ? VOLUME_LAYOUT_LINEAR : new_layout;
+	storage_voxels = GetStorageVoxels(resolution, layout);
+	offset_x.resize(resolution.x);
+	offset_y.resize(resolution.y);
+	offset_z.resize(resolution.z);
+
+	switch (layout) {
+		case VOLUME_LAYOUT_MORTON: {
+			// Interleave the bits of x, y and z
+			const glm::ivec3 bits = GetMortonBits(resolution);
+			const int max_bits = std::max({ bits.x, bits.y, bits.z });
+			int32_t* tables[3] = { offset_x.data(), offset_y.data(), offset_z.data() };
+			for (int axis = 0; axis < 3; axis++) {
+				for (int i = 0; i < resolution[axis]; i++) {
+					uint64_t code = 0;
+					int out_bit = 0;
+					for (int bit = 0; bit < max_bits; bit++) {
+						for (int a = 0; a < 3; a++) {
+							if (bit >= bits[a]) {
+								continue;
+							}
+							if (a == axis && (i >> bit) & 1) {
+								code |= static_cast<uint64_t>(1) << out_bit;
+							}
+							out_bit++;
+						}
+					}
+					tables[axis][i] = static_cast<int32_t>(code);
+				}
+			}
+			break;
+		}
+		case VOLUME_LAYOUT_BRICKED: {
+			const glm::ivec3 bricks = (resolution + glm::ivec3(kBrickSize - 1)) / kBrickSize;
+			const int32_t brick_voxels = kBrickSize * kBrickSize * kBrickSize;
+			for (int x = 0; x < resolution.x; x++) {
+				offset_x[x] = (x / kBrickSize) * brick_voxels + (x % kBrickSize);
+			}
+			for (int y = 0; y < resolution.y; y++) {
+				offset_y[y] = (y / kBrickSize) * bricks.x * brick_voxels + (y % kBrickSize) * kBrickSize;
+			}
+			for (int z = 0; z < resolution.z; z++) {
+				offset_z[z] = (z / kBrickSize) * bricks.x * bricks.y * brick_voxels + (z % kBrickSize) * kBrickSize * kBrickSize;
+			}
+			break;
+		}
+		case VOLUME_LAYOUT_LINEAR:
+		default:
+			for (int x = 0; x < resolution.x; x++) {
+				offset_x[x] = x;
+			}
+			for (int y = 0; y < resolution.y; y++) {
+				offset_y[y] = y * resolution.x;
+			}
+			for (int z = 0; z < resolution.z; z++) {
+				offset_z[z] = z * resolution.x * resolution.y;
+			}
+			break;
+	}
+}
+
+const char* VoxelLayout::GetLayoutName(VolumeLayout layout) {
+	switch (layout) {
+		case VOLUME_LAYOUT_LINEAR:
+			return "Linear";
+		case VOLUME_LAYOUT_MORTON:
+			return "Morton (Z-order)";
+		case VOLUME_LAYOUT_BRICKED:
+			return "Bricked 8^3";
+		default:
+			return "Unknown";
+	}
+}
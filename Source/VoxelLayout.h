@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// In-memory order of the voxels.
+enum VolumeLayout {
+	VOLUME_LAYOUT_LINEAR,	// x-major, same as the .raw file
+	VOLUME_LAYOUT_MORTON,	// Z-order curve, every axis padded to a power of two
+	VOLUME_LAYOUT_BRICKED,	// 8x8x8 bricks, x-major inside and between bricks
+};
+
+// Where the voxel (x, y, z) of a layout is stored: offset_x[x] + offset_y[y] + offset_z[z], whatever the layout is,
+// so CPU kernels only need the three offset tables to address any layout. Shared by VolumeData and RawVolume.
+class VoxelLayout {
+public:
+	// Fill the offset tables. Falls back to VOLUME_LAYOUT_LINEAR if the padded storage would have more than
+	// max_storage_voxels; the linear storage itself must fit, every offset is an int32.
+	void Build(const glm::ivec3& resolution, VolumeLayout layout, size_t max_storage_voxels);
+
+	size_t Index(int x, int y, int z) const {
+		return static_cast<size_t>(offset_x[x]) + offset_y[y] + offset_z[z];
+	}
+	VolumeLayout GetLayout() const { return layout; }
+	// Voxels the storage needs, padding included
+	size_t GetStorageVoxels() const { return storage_voxels; }
+	const int32_t* GetOffsetsX() const { return offset_x.data(); }
+	const int32_t* GetOffsetsY() const { return offset_y.data(); }
+	const int32_t* GetOffsetsZ() const { return offset_z.data(); }
+
+	static const char* GetLayoutName(VolumeLayout layout);
+	static size_t GetStorageVoxels(const glm::ivec3& resolution, VolumeLayout layout);
+
+private:
+	VolumeLayout layout = VOLUME_LAYOUT_LINEAR;
+	size_t storage_voxels = 0;
+	std::vector<int32_t> offset_x;
+	std::vector<int32_t> offset_y;
+	std::vector<int32_t> offset_z;
+};